@@ -0,0 +1,145 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#include "LabelCache.h"
+#include "LabelMap.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _MSC_VER
+#  include <direct.h>
+#  include <process.h>
+#  define getpid _getpid
+#else
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+uint64 LabelCache::MakeKey(const uint32 *pixels, int width, int height, int depth,
+                           int STEP, double m) {
+  const size_t nPixels = static_cast<size_t>(width) * height * depth;
+
+  uint64 mBits;
+  memcpy(&mBits, &m, sizeof(mBits));
+
+  const uint64 params[] = {
+    static_cast<uint64>(width),
+    static_cast<uint64>(height),
+    static_cast<uint64>(depth),
+    static_cast<uint64>(STEP),
+    mBits,
+    HashBytes(pixels, nPixels * sizeof(uint32), kSegmentationVersion)
+  };
+  return HashBytes(params, sizeof(params), kSegmentationVersion);
+}
+
+std::string LabelCache::EntryPath(uint64 key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.lbl", static_cast<unsigned long long>(key));
+  return m_Dir + "/" + name;
+}
+
+bool LabelCache::Load(uint64 key, int width, int height, int depth,
+                      int *labels, int &numLabels) const {
+  if(!IsEnabled()) {
+    return false;
+  }
+
+  LabelMapFile file;
+  if(!file.Open(EntryPath(key)) || file.GetTag() != key ||
+     file.GetWidth() != width || file.GetHeight() != height ||
+     file.GetDepth() != depth || !file.Decode(labels)) {
+    return false;
+  }
+
+  numLabels = file.GetNumLabels();
+  return true;
+}
+
+static bool MakeDirectory(const std::string &dir) {
+#ifdef _MSC_VER
+  return _mkdir(dir.c_str()) == 0 || errno == EEXIST;
+#else
+  return mkdir(dir.c_str(), 0777) == 0 || errno == EEXIST;
+#endif
+}
+
+bool LabelCache::Store(uint64 key, int width, int height, int depth,
+                       const int *labels, int numLabels) const {
+  if(!IsEnabled() || !MakeDirectory(m_Dir)) {
+    return false;
+  }
+
+  // Writers of the same key each get their own temporary file, or one
+  // could rename another's half written file into place.
+  static std::atomic<uint32> numStores(0);
+  const std::string path = EntryPath(key);
+  const std::string tmpPath = path + "." + std::to_string(getpid()) + "." +
+    std::to_string(numStores++) + ".tmp";
+  if(!WriteLabelMap(tmpPath, labels, width, height, depth, numLabels, key)) {
+    remove(tmpPath.c_str());
+    return false;
+  }
+
+  // rename() does not replace an existing file on Windows
+  if(rename(tmpPath.c_str(), path.c_str()) != 0) {
+    remove(path.c_str());
+    if(rename(tmpPath.c_str(), path.c_str()) != 0) {
+      remove(tmpPath.c_str());
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,100 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#ifndef _LABEL_CACHE_H__
+#define _LABEL_CACHE_H__
+
+#include "TexCompTypes.h"
+
+#include <string>
+
+// An on-disk cache of segmentations. Each entry is keyed by a hash of the
+// input pixels and of the parameters that produced the labels, so running
+// sc again on the same image(s) can skip SLIC entirely. An entry is a label
+// map file (see LabelMap.h) tagged with its key.
+class LabelCache {
+ public:
+  // Bump whenever a change to the segmentation would produce different
+  // labels for the same input, so that stale entries are never hit.
+  static const uint32 kSegmentationVersion = 1;
+
+  // An empty directory disables the cache; Load() then always misses and
+  // Store() does nothing.
+  explicit LabelCache(const std::string &dir) : m_Dir(dir) { }
+
+  bool IsEnabled() const { return !m_Dir.empty(); }
+
+  // The key of a segmentation of the given pixels with superpixel step
+  // STEP and compactness m.
+  static uint64 MakeKey(const uint32 *pixels, int width, int height, int depth,
+                        int STEP, double m);
+
+  // Decodes the entry for key into labels (width * height * depth of
+  // them). Returns false if there is no entry, or if it is truncated,
+  // corrupt or for a different size.
+  bool Load(uint64 key, int width, int height, int depth,
+            int *labels, int &numLabels) const;
+
+  // Writes the entry for key. The file is written under a temporary name
+  // unique to this process and call, and renamed into place, so a
+  // concurrent Load() never sees a partial entry, even while other
+  // threads or processes store the same key.
+  bool Store(uint64 key, int width, int height, int depth,
+             const int *labels, int numLabels) const;
+
+ private:
+  std::string EntryPath(uint64 key) const;
+
+  std::string m_Dir;
+};
+
+#endif // _LABEL_CACHE_H__
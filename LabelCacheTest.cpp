@@ -0,0 +1,401 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "LabelCache.h"
+#include "LabelMap.h"
+#include "SLIC.h"
+#include "TexCompTypes.h"
+#include "StopWatch.h"
+
+static const char *kCacheDir = "label_cache_test";
+static const char *kLabelMapFile = "label_map_test.lbl";
+
+// Labels of a grid of jittered blocks, roughly what SLIC produces
+static void GenerateLabels(const int w, const int h, const int step,
+                           std::vector<int> &labels, int &numLabels) {
+  const int nx = (w + step - 1) / step;
+  const int ny = (h + step - 1) / step;
+  labels.resize(w * h);
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      const int jx = std::min(nx - 1, std::max(0, (x + (y * 7 / step) % 3 - 1) / step));
+      const int jy = std::min(ny - 1, std::max(0, (y + (x * 5 / step) % 3 - 1) / step));
+      labels[y*w + x] = jy * nx + jx;
+    }
+  }
+  numLabels = nx * ny;
+}
+
+static bool TestHash() {
+  const char *kLong = "Nobody inspects the spammish repetition";
+  const bool ok =
+    HashBytes("", 0) == 0xEF46DB3751D8E999ULL &&
+    HashBytes("abc", 3) == 0x44BC2CF5AD770999ULL &&
+    HashBytes(kLong, strlen(kLong)) == 0xFBCEA83C8A378BF1ULL;
+
+  std::cout << "XXH64 reference values: " << (ok ? "match" : "MISMATCH")
+            << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestLabelMap() {
+  std::vector<int> labels, loaded;
+  int numLabels;
+  bool ok = true;
+
+  // Segmentation like rows, noisy rows that fall back to raw labels, and
+  // the label widths either side of each boundary
+  const int w = 301, h = 67, d = 3;
+  GenerateLabels(w, h * d, 24, labels, numLabels);
+  for(int x = 0; x < w; x++) {
+    labels[5*w + x] = rand() % numLabels;
+  }
+  const int labelCounts[] = { numLabels, 256, 257, 65536, 65537, 1 << 24 };
+  for(size_t c = 0; c < sizeof(labelCounts) / sizeof(labelCounts[0]); c++) {
+    const int n = labelCounts[c];
+    if(n != numLabels) {
+      for(int x = 0; x < w; x++) {
+        labels[7*w + x] = x == 0 ? n - 1 : rand() % n;
+      }
+    }
+
+    LabelMapFile file;
+    loaded.assign(w * h * d, -1);
+    ok = ok && WriteLabelMap(kLabelMapFile, &labels[0], w, h, d, n, 42 + c);
+    ok = ok && file.Open(kLabelMapFile) && file.GetTag() == 42 + c &&
+      file.GetWidth() == w && file.GetHeight() == h && file.GetDepth() == d &&
+      file.GetNumLabels() == n;
+    ok = ok && file.Decode(&loaded[0]) && loaded == labels;
+
+    // Any range of rows decodes on its own
+    std::vector<int> rows(10 * w);
+    ok = ok && file.DecodeRows(&rows[0], 3, 10) &&
+      std::equal(rows.begin(), rows.end(), labels.begin() + 3 * w);
+    ok = ok && !file.DecodeRows(&rows[0], h * d - 5, 10);
+  }
+
+  // A label past numLabels is caught on decode
+  {
+    LabelMapFile file;
+    ok = ok && WriteLabelMap(kLabelMapFile, &labels[0], w, h, d, 10);
+    ok = ok && file.Open(kLabelMapFile) && !file.Decode(&loaded[0]);
+  }
+  remove(kLabelMapFile);
+
+  std::cout << "Label map round trip: " << (ok ? "exact" : "FAILED")
+            << std::endl << std::endl;
+  return ok;
+}
+
+static long FileSize(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if(!f) {
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fclose(f);
+  return size;
+}
+
+static bool TestLabelMapSize() {
+  const int w = 4096, h = 4096;
+  std::vector<int> labels, loaded(w * h);
+  int numLabels;
+  GenerateLabels(w, h, 16, labels, numLabels);
+  StopWatch stopwatch;
+
+  stopwatch.Start();
+  SLIC<float> slic;
+  slic.SaveSuperpixelLabels(&labels[0], w, h, "label_map_test.png", "");
+  stopwatch.Stop();
+  const double rawTime = stopwatch.TimeInMilliseconds();
+  const long rawSize = FileSize("label_map_test.dat");
+
+  stopwatch.Reset();
+  stopwatch.Start();
+  bool ok = WriteLabelMap(kLabelMapFile, &labels[0], w, h, 1, numLabels);
+  stopwatch.Stop();
+  const double writeTime = stopwatch.TimeInMilliseconds();
+  const long mapSize = FileSize(kLabelMapFile);
+
+  stopwatch.Reset();
+  stopwatch.Start();
+  LabelMapFile file;
+  ok = ok && file.Open(kLabelMapFile) && file.Decode(&loaded[0]);
+  stopwatch.Stop();
+  const double readTime = stopwatch.TimeInMilliseconds();
+  ok = ok && loaded == labels;
+
+  std::cout << "Raw labels (" << w << "x" << h << "): " << rawSize << " bytes in "
+            << rawTime << " ms" << std::endl;
+  std::cout << "Label map: " << mapSize << " bytes, written in " << writeTime
+            << " ms, read in " << readTime << " ms" << std::endl << std::endl;
+
+  remove("label_map_test.dat");
+  remove(kLabelMapFile);
+  return ok && rawSize == long(w) * h * long(sizeof(int)) && mapSize * 8 < rawSize;
+}
+
+static bool TestKey() {
+  std::vector<uint32> img(64 * 64);
+  for(size_t i = 0; i < img.size(); i++) {
+    img[i] = rand();
+  }
+
+  const uint64 key = LabelCache::MakeKey(&img[0], 64, 64, 1, 8, 1.0);
+  bool ok = key == LabelCache::MakeKey(&img[0], 64, 64, 1, 8, 1.0);
+  ok = ok && key != LabelCache::MakeKey(&img[0], 64, 64, 1, 9, 1.0);
+  ok = ok && key != LabelCache::MakeKey(&img[0], 64, 64, 1, 8, 2.0);
+  ok = ok && key != LabelCache::MakeKey(&img[0], 32, 128, 1, 8, 1.0);
+  ok = ok && key != LabelCache::MakeKey(&img[0], 64, 32, 2, 8, 1.0);
+
+  img[1234] ^= 1;
+  ok = ok && key != LabelCache::MakeKey(&img[0], 64, 64, 1, 8, 1.0);
+
+  std::cout << "Keys depend on pixels and parameters: " << (ok ? "yes" : "no")
+            << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestRoundTrip() {
+  LabelCache cache(kCacheDir);
+  const int w = 97, h = 61;
+  std::vector<int> labels(w * h), loaded(w * h);
+
+  bool ok = true;
+  const int labelCounts[] = { 1, 200, 256, 257, 40000, 65536, 65537, 1 << 20 };
+  for(size_t c = 0; c < sizeof(labelCounts) / sizeof(labelCounts[0]); c++) {
+    const int n = labelCounts[c];
+    for(int i = 0; i < w * h; i++) {
+      labels[i] = rand() % n;
+    }
+    labels[0] = n - 1;
+
+    const uint64 key = 0x5C00 + c;
+    int numLoaded = 0;
+    ok = ok && cache.Store(key, w, h, 1, &labels[0], n);
+    ok = ok && cache.Load(key, w, h, 1, &loaded[0], numLoaded);
+    ok = ok && numLoaded == n && loaded == labels;
+
+    // Wrong size or a missing key must miss
+    ok = ok && !cache.Load(key, h, w, 1, &loaded[0], numLoaded);
+    ok = ok && !cache.Load(key + 0x100, w, h, 1, &loaded[0], numLoaded);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%016llx.lbl", kCacheDir, static_cast<unsigned long long>(key));
+    remove(path);
+  }
+
+  std::cout << "Round trip at all label widths: " << (ok ? "exact" : "FAILED")
+            << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestCorruption() {
+  LabelCache cache(kCacheDir);
+  const int w = 64, h = 64;
+  const uint64 key = 0xC0DE;
+  std::vector<int> labels(w * h), loaded(w * h);
+  for(int i = 0; i < w * h; i++) {
+    labels[i] = i / 37;
+  }
+  cache.Store(key, w, h, 1, &labels[0], (w * h) / 37 + 1);
+
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%016llx.lbl", kCacheDir, static_cast<unsigned long long>(key));
+
+  std::vector<char> file;
+  FILE *f = fopen(path, "rb");
+  for(int ch; f && (ch = fgetc(f)) != EOF; ) {
+    file.push_back(static_cast<char>(ch));
+  }
+  if(f) {
+    fclose(f);
+  }
+
+  // Flip one bit in the labels, then truncate
+  bool ok = !file.empty();
+  int numLoaded;
+  if(ok) {
+    std::vector<char> bad(file);
+    bad[bad.size() / 2] ^= 0x10;
+    f = fopen(path, "wb");
+    fwrite(&bad[0], 1, bad.size(), f);
+    fclose(f);
+    ok = !cache.Load(key, w, h, 1, &loaded[0], numLoaded);
+
+    f = fopen(path, "wb");
+    fwrite(&file[0], 1, file.size() - 1, f);
+    fclose(f);
+    ok = ok && !cache.Load(key, w, h, 1, &loaded[0], numLoaded);
+  }
+  remove(path);
+
+  std::cout << "Corrupt and truncated entries rejected: " << (ok ? "yes" : "no")
+            << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestConcurrentStore() {
+  LabelCache cache(kCacheDir);
+  const int w = 1024, h = 1024, numLabels = 1000, kNumThreads = 4, kNumStores = 10;
+  const uint64 key = 0xC0C0;
+
+  // Each thread keeps storing its own labels for the same key
+  std::vector<std::vector<int> > labels(kNumThreads, std::vector<int>(w * h));
+  for(int t = 0; t < kNumThreads; t++) {
+    for(int i = 0; i < w * h; i++) {
+      labels[t][i] = static_cast<int>((static_cast<uint32>(i) * 7919 + t) % numLabels);
+    }
+  }
+
+  std::vector<std::thread> threads;
+  for(int t = 0; t < kNumThreads; t++) {
+    threads.push_back(std::thread([&cache, &labels, t, key]() {
+      for(int s = 0; s < kNumStores; s++) {
+        cache.Store(key, w, h, 1, &labels[t][0], numLabels);
+      }
+    }));
+  }
+
+  // Meanwhile every load either misses or gets one thread's labels whole
+  std::vector<int> loaded(w * h);
+  int numLoaded, numHits = 0;
+  bool ok = true;
+  for(int l = 0; l < 200; l++) {
+    if(cache.Load(key, w, h, 1, &loaded[0], numLoaded)) {
+      numHits++;
+      ok = ok && numLoaded == numLabels &&
+        std::find(labels.begin(), labels.end(), loaded) != labels.end();
+    }
+  }
+  for(size_t t = 0; t < threads.size(); t++) {
+    threads[t].join();
+  }
+
+  // Once they are done the entry is complete
+  ok = ok && cache.Load(key, w, h, 1, &loaded[0], numLoaded) &&
+    std::find(labels.begin(), labels.end(), loaded) != labels.end();
+
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%016llx.lbl", kCacheDir, static_cast<unsigned long long>(key));
+  remove(path);
+
+  std::cout << "Concurrent stores of one key (" << numHits << " hits while storing): "
+            << (ok ? "whole" : "TORN") << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestHitTime() {
+  const int w = 1024, h = 1024, step = 8;
+  std::vector<unsigned int> img(w * h);
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      const uint32 v = ((x / 61) * 37 + (y / 47) * 91) & 0xFF;
+      img[y*w + x] = 0xFF000000 | (v << 16) | ((255 - v) << 8) | ((x ^ y) & 0xFF);
+    }
+  }
+
+  LabelCache cache(kCacheDir);
+  std::vector<int> labels(w * h), loaded(w * h);
+  int numLabels, numLoaded = 0;
+  StopWatch stopwatch;
+
+  stopwatch.Start();
+  SLIC<float> slic;
+  slic.PerformSLICO_ForGivenStepSize(&img[0], w, h, &labels[0], numLabels, step, 1.0);
+  stopwatch.Stop();
+  const double segmentTime = stopwatch.TimeInMilliseconds();
+
+  stopwatch.Reset();
+  stopwatch.Start();
+  const uint64 key = LabelCache::MakeKey(&img[0], w, h, 1, step, 1.0);
+  const bool hit = cache.Store(key, w, h, 1, &labels[0], numLabels) &&
+    cache.Load(key, w, h, 1, &loaded[0], numLoaded);
+  stopwatch.Stop();
+  const double cacheTime = stopwatch.TimeInMilliseconds();
+
+  std::cout << "SLIC on " << w << "x" << h << ": " << segmentTime << " ms" << std::endl;
+  std::cout << "Key, store and load: " << cacheTime << " ms" << std::endl << std::endl;
+
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%016llx.lbl", kCacheDir, static_cast<unsigned long long>(key));
+  remove(path);
+
+  return hit && numLoaded == numLabels && loaded == labels;
+}
+
+int main() {
+  srand(0);
+
+  bool ok = true;
+  ok = TestHash() && ok;
+  ok = TestLabelMap() && ok;
+  ok = TestLabelMapSize() && ok;
+  ok = TestKey() && ok;
+  ok = TestRoundTrip() && ok;
+  ok = TestCorruption() && ok;
+  ok = TestConcurrentStore() && ok;
+  ok = TestHitTime() && ok;
+
+  std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
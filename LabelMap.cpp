@@ -0,0 +1,523 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#include "LabelMap.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _MSC_VER
+#  include <SDKDDKVer.h>
+#  include <Windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+static const uint32 kMagic = 0x4D4C4353; // "SCLM"
+static const uint32 kFormatVersion = 1;
+static const size_t kHeaderSize = 8 * sizeof(uint32) + sizeof(uint64);
+static const size_t kChecksumSize = sizeof(uint64);
+
+static const uint8 kRowRuns = 0;
+static const uint8 kRowRaw = 1;
+
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Little endian field access
+//
+////////////////////////////////////////////////////////////////////////////////
+
+static inline uint32 Read32(const uint8 *p) {
+  return static_cast<uint32>(p[0]) | (static_cast<uint32>(p[1]) << 8) |
+    (static_cast<uint32>(p[2]) << 16) | (static_cast<uint32>(p[3]) << 24);
+}
+
+static inline uint64 Read64(const uint8 *p) {
+  return static_cast<uint64>(Read32(p)) | (static_cast<uint64>(Read32(p + 4)) << 32);
+}
+
+static inline void Write32(uint8 *p, uint32 v) {
+  p[0] = static_cast<uint8>(v);
+  p[1] = static_cast<uint8>(v >> 8);
+  p[2] = static_cast<uint8>(v >> 16);
+  p[3] = static_cast<uint8>(v >> 24);
+}
+
+static inline void Write64(uint8 *p, uint64 v) {
+  Write32(p, static_cast<uint32>(v));
+  Write32(p + 4, static_cast<uint32>(v >> 32));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// XXH64
+//
+////////////////////////////////////////////////////////////////////////////////
+
+static const uint64 kPrime1 = 0x9E3779B185EBCA87ULL;
+static const uint64 kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64 kPrime3 = 0x165667B19E3779F9ULL;
+static const uint64 kPrime4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64 kPrime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64 Rotl(uint64 x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64 HashRound(uint64 acc, uint64 input) {
+  acc += input * kPrime2;
+  acc = Rotl(acc, 31);
+  return acc * kPrime1;
+}
+
+static inline uint64 HashMerge(uint64 acc, uint64 val) {
+  acc ^= HashRound(0, val);
+  return acc * kPrime1 + kPrime4;
+}
+
+uint64 HashBytes(const void *data, size_t nBytes, uint64 seed) {
+  const uint8 *p = static_cast<const uint8 *>(data);
+  const uint8 *const end = p + nBytes;
+
+  uint64 h;
+  if(nBytes >= 32) {
+    uint64 v1 = seed + kPrime1 + kPrime2;
+    uint64 v2 = seed + kPrime2;
+    uint64 v3 = seed;
+    uint64 v4 = seed - kPrime1;
+    const uint8 *const limit = end - 32;
+    do {
+      v1 = HashRound(v1, Read64(p));
+      v2 = HashRound(v2, Read64(p + 8));
+      v3 = HashRound(v3, Read64(p + 16));
+      v4 = HashRound(v4, Read64(p + 24));
+      p += 32;
+    } while(p <= limit);
+
+    h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+    h = HashMerge(h, v1);
+    h = HashMerge(h, v2);
+    h = HashMerge(h, v3);
+    h = HashMerge(h, v4);
+  } else {
+    h = seed + kPrime5;
+  }
+
+  h += static_cast<uint64>(nBytes);
+
+  for(; p + 8 <= end; p += 8) {
+    h ^= HashRound(0, Read64(p));
+    h = Rotl(h, 27) * kPrime1 + kPrime4;
+  }
+  if(p + 4 <= end) {
+    h ^= static_cast<uint64>(Read32(p)) * kPrime1;
+    h = Rotl(h, 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for(; p < end; p++) {
+    h ^= static_cast<uint64>(*p) * kPrime5;
+    h = Rotl(h, 11) * kPrime1;
+  }
+
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Row coding
+//
+////////////////////////////////////////////////////////////////////////////////
+
+static inline uint8 *PutVarint(uint8 *out, uint32 v) {
+  while(v >= 0x80) {
+    *out++ = static_cast<uint8>(v | 0x80);
+    v >>= 7;
+  }
+  *out++ = static_cast<uint8>(v);
+  return out;
+}
+
+static inline bool GetVarint(const uint8 *&p, const uint8 *end, uint32 &v) {
+  v = 0;
+  for(int shift = 0; shift < 35 && p < end; shift += 7) {
+    const uint8 b = *p++;
+    v |= static_cast<uint32>(b & 0x7F) << shift;
+    if(!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static inline uint32 ZigZag(int v) {
+  return (static_cast<uint32>(v) << 1) ^ static_cast<uint32>(v >> 31);
+}
+
+static inline int UnZigZag(uint32 v) {
+  return static_cast<int>(v >> 1) ^ -static_cast<int>(v & 1);
+}
+
+// The most bytes EncodeRow() writes for a row
+static inline size_t MaxRowSize(int width, uint32 labelBytes) {
+  return 1 + static_cast<size_t>(width) * labelBytes;
+}
+
+// Encodes a row into out, which has room for MaxRowSize() bytes, and
+// returns the number of bytes written.
+static size_t EncodeRow(uint8 *out, const int *row, int width, uint32 labelBytes) {
+  const size_t rawSize = static_cast<size_t>(width) * labelBytes;
+
+  //-----------------------------------------------------------------
+  // Runs, until they cost more than the raw labels. Each run is staged
+  // in runs[] (at most ten bytes) so the row never outgrows out.
+  //-----------------------------------------------------------------
+  uint8 runs[16];
+  uint8 *p = out;
+  *p++ = kRowRuns;
+  int prev = 0;
+  for(int x = 0; x < width; ) {
+    const int l = row[x];
+    int run = 1;
+    while(x + run < width && row[x + run] == l) {
+      run++;
+    }
+
+    uint8 *end = PutVarint(runs, ZigZag(l - prev));
+    end = PutVarint(end, static_cast<uint32>(run - 1));
+    const size_t n = end - runs;
+    if(static_cast<size_t>(p - out) + n > 1 + rawSize) {
+      p = NULL;
+      break;
+    }
+    memcpy(p, runs, n);
+    p += n;
+    prev = l;
+    x += run;
+  }
+  if(p) {
+    return p - out;
+  }
+
+  out[0] = kRowRaw;
+  for(int x = 0; x < width; x++) {
+    const uint32 l = static_cast<uint32>(row[x]);
+    for(uint32 b = 0; b < labelBytes; b++) {
+      out[1 + x*labelBytes + b] = static_cast<uint8>(l >> (8*b));
+    }
+  }
+  return 1 + rawSize;
+}
+
+bool WriteLabelMap(const std::string &filename, const int *labels,
+                   int width, int height, int depth, int numLabels, uint64 tag) {
+  const size_t numRows = static_cast<size_t>(height) * depth;
+  uint32 labelBytes = 4;
+  if(numLabels <= 0x100) {
+    labelBytes = 1;
+  } else if(numLabels <= 0x10000) {
+    labelBytes = 2;
+  }
+
+  //-----------------------------------------------------------------
+  // Encode everything into one buffer, rows first so that their
+  // offsets are known before the table is filled in
+  //-----------------------------------------------------------------
+  const size_t rowsStart = kHeaderSize + (numRows + 1) * sizeof(uint64);
+  const size_t maxRow = MaxRowSize(width, labelBytes);
+  std::vector<uint8> buf(rowsStart + numRows * (width / 4 + 8) + maxRow + kChecksumSize);
+
+  std::vector<uint64> offsets(numRows + 1);
+  size_t pos = rowsStart;
+  for(size_t r = 0; r < numRows; r++) {
+    if(buf.size() < pos + maxRow + kChecksumSize) {
+      buf.resize(2 * buf.size());
+    }
+    offsets[r] = pos - rowsStart;
+    pos += EncodeRow(&buf[pos], labels + r * width, width, labelBytes);
+  }
+  offsets[numRows] = pos - rowsStart;
+
+  uint8 *header = &buf[0];
+  Write32(header, kMagic);
+  Write32(header + 4, kFormatVersion);
+  Write64(header + 8, tag);
+  Write32(header + 16, static_cast<uint32>(width));
+  Write32(header + 20, static_cast<uint32>(height));
+  Write32(header + 24, static_cast<uint32>(depth));
+  Write32(header + 28, static_cast<uint32>(numLabels));
+  Write32(header + 32, labelBytes);
+  Write32(header + 36, 0);
+  for(size_t r = 0; r <= numRows; r++) {
+    Write64(header + kHeaderSize + r * sizeof(uint64), offsets[r]);
+  }
+
+  const size_t checked = pos;
+  buf.resize(checked + kChecksumSize);
+  Write64(&buf[checked], HashBytes(&buf[0], checked));
+
+  FILE *f = fopen(filename.c_str(), "wb");
+  if(!f) {
+    return false;
+  }
+  const bool written = fwrite(&buf[0], 1, buf.size(), f) == buf.size();
+  return fclose(f) == 0 && written;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Reader
+//
+////////////////////////////////////////////////////////////////////////////////
+
+LabelMapFile::LabelMapFile()
+  : m_Data(NULL)
+  , m_Size(0)
+#ifdef _MSC_VER
+  , m_File(INVALID_HANDLE_VALUE)
+  , m_Mapping(NULL)
+#endif
+  , m_Tag(0)
+  , m_Width(0)
+  , m_Height(0)
+  , m_Depth(0)
+  , m_NumLabels(0)
+  , m_LabelBytes(0)
+  , m_Offsets(NULL)
+  , m_Rows(NULL)
+  , m_RowsSize(0)
+{ }
+
+LabelMapFile::~LabelMapFile() {
+  Close();
+}
+
+void LabelMapFile::Close() {
+#ifdef _MSC_VER
+  if(m_Data) {
+    UnmapViewOfFile(m_Data);
+  }
+  if(m_Mapping) {
+    CloseHandle(m_Mapping);
+  }
+  if(m_File != INVALID_HANDLE_VALUE) {
+    CloseHandle(m_File);
+  }
+  m_File = INVALID_HANDLE_VALUE;
+  m_Mapping = NULL;
+#else
+  if(m_Data) {
+    munmap(const_cast<uint8 *>(m_Data), m_Size);
+  }
+#endif
+  m_Data = NULL;
+  m_Size = 0;
+}
+
+bool LabelMapFile::Open(const std::string &filename) {
+  Close();
+
+  //-----------------------------------------------------------------
+  // Map the whole file read only
+  //-----------------------------------------------------------------
+#ifdef _MSC_VER
+  m_File = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  LARGE_INTEGER fileSize;
+  if(m_File == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_File, &fileSize) ||
+     fileSize.QuadPart == 0) {
+    Close();
+    return false;
+  }
+  m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+  if(m_Mapping) {
+    m_Data = static_cast<const uint8 *>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+  }
+  if(!m_Data) {
+    Close();
+    return false;
+  }
+  m_Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void *data = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) {
+    return false;
+  }
+  m_Data = static_cast<const uint8 *>(data);
+  m_Size = static_cast<size_t>(st.st_size);
+#endif
+
+  //-----------------------------------------------------------------
+  // Validate the header and the row table before trusting either
+  //-----------------------------------------------------------------
+  if(m_Size < kHeaderSize + sizeof(uint64) + kChecksumSize ||
+     Read32(m_Data) != kMagic || Read32(m_Data + 4) != kFormatVersion) {
+    Close();
+    return false;
+  }
+
+  const uint32 width = Read32(m_Data + 16);
+  const uint32 height = Read32(m_Data + 20);
+  const uint32 depth = Read32(m_Data + 24);
+  const uint32 numLabels = Read32(m_Data + 28);
+  const uint32 labelBytes = Read32(m_Data + 32);
+  const uint64 numRows = static_cast<uint64>(height) * depth;
+  if(width > INT_MAX || numLabels > INT_MAX || numRows > INT_MAX ||
+     (labelBytes != 1 && labelBytes != 2 && labelBytes != 4) ||
+     (m_Size - kHeaderSize - kChecksumSize) / sizeof(uint64) < numRows + 1) {
+    Close();
+    return false;
+  }
+
+  const size_t rowsStart = kHeaderSize + static_cast<size_t>(numRows + 1) * sizeof(uint64);
+  const size_t rowsSize = m_Size - kChecksumSize - rowsStart;
+  const uint8 *offsets = m_Data + kHeaderSize;
+  bool ok = Read64(offsets) == 0 && Read64(offsets + numRows * sizeof(uint64)) == rowsSize;
+  for(uint64 r = 0; ok && r < numRows; r++) {
+    ok = Read64(offsets + r * sizeof(uint64)) < Read64(offsets + (r + 1) * sizeof(uint64));
+  }
+
+  const size_t checked = m_Size - kChecksumSize;
+  if(!ok || HashBytes(m_Data, checked) != Read64(m_Data + checked)) {
+    Close();
+    return false;
+  }
+
+  m_Tag = Read64(m_Data + 8);
+  m_Width = static_cast<int>(width);
+  m_Height = static_cast<int>(height);
+  m_Depth = static_cast<int>(depth);
+  m_NumLabels = static_cast<int>(numLabels);
+  m_LabelBytes = static_cast<int>(labelBytes);
+  m_Offsets = offsets;
+  m_Rows = m_Data + rowsStart;
+  m_RowsSize = rowsSize;
+  return true;
+}
+
+bool LabelMapFile::DecodeRows(int *labels, int firstRow, int numRows) const {
+  if(!IsOpen() || firstRow < 0 || numRows < 0 ||
+     numRows > m_Height * m_Depth - firstRow) {
+    return false;
+  }
+
+  const int width = m_Width;
+  for(int r = 0; r < numRows; r++) {
+    const size_t row = static_cast<size_t>(firstRow + r);
+    const uint8 *p = m_Rows + Read64(m_Offsets + row * sizeof(uint64));
+    const uint8 *const end = m_Rows + Read64(m_Offsets + (row + 1) * sizeof(uint64));
+    int *dst = labels + static_cast<size_t>(r) * width;
+
+    const uint8 mode = *p++;
+    if(mode == kRowRaw) {
+      if(end - p != static_cast<ptrdiff_t>(width) * m_LabelBytes) {
+        return false;
+      }
+      for(int x = 0; x < width; x++, p += m_LabelBytes) {
+        uint32 l = p[0];
+        for(int b = 1; b < m_LabelBytes; b++) {
+          l |= static_cast<uint32>(p[b]) << (8*b);
+        }
+        if(l >= static_cast<uint32>(m_NumLabels)) {
+          return false;
+        }
+        dst[x] = static_cast<int>(l);
+      }
+      continue;
+    }
+    if(mode != kRowRuns) {
+      return false;
+    }
+
+    int prev = 0;
+    for(int x = 0; x < width; ) {
+      uint32 delta, run;
+      if(!GetVarint(p, end, delta) || !GetVarint(p, end, run) ||
+         run >= static_cast<uint32>(width - x)) {
+        return false;
+      }
+      // Unsigned, so that a corrupt delta cannot overflow
+      const uint32 l = static_cast<uint32>(prev) + static_cast<uint32>(UnZigZag(delta));
+      if(l >= static_cast<uint32>(m_NumLabels)) {
+        return false;
+      }
+      std::fill_n(dst + x, run + 1, static_cast<int>(l));
+      prev = static_cast<int>(l);
+      x += run + 1;
+    }
+    if(p != end) {
+      return false;
+    }
+  }
+  return true;
+}
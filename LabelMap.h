@@ -0,0 +1,142 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#ifndef _LABEL_MAP_H__
+#define _LABEL_MAP_H__
+
+#include "TexCompTypes.h"
+
+#include <cstddef>
+#include <string>
+
+// A compact file format for superpixel labels.
+//
+//   magic "SCLM", format version      (uint32 each)
+//   tag                               (uint64, free for the writer to use)
+//   width, height, depth, numLabels   (uint32 each)
+//   label width in bytes, reserved    (uint32 each: 1, 2 or 4, then 0)
+//   row offsets                       (uint64, height * depth + 1 of them)
+//   rows
+//   checksum                          (uint64, XXH64 of everything above)
+//
+// All fields are little endian and the row offsets are relative to the
+// first row. Each row starts with a mode byte:
+//
+//   0: runs. Each run is the zigzag varint of the label minus the label of
+//      the previous run (zero at the start of the row), followed by the
+//      varint of the run length minus one.
+//   1: raw. width labels at the label width, for rows too noisy to run
+//      length encode.
+//
+// Rows are independent, so a reader can decode any range of them.
+
+// XXH64 of the given bytes.
+extern uint64 HashBytes(const void *data, size_t nBytes, uint64 seed = 0);
+
+// Encodes the labels of a width x height x depth volume (depth is 1 for an
+// image) and writes them with a single write. Returns false on I/O errors.
+extern bool WriteLabelMap(const std::string &filename, const int *labels,
+                          int width, int height, int depth, int numLabels,
+                          uint64 tag = 0);
+
+// Memory maps a label map file for reading. Open() validates the header,
+// the row offsets and the checksum, after which the rows can be decoded
+// straight into the caller's label buffer.
+class LabelMapFile {
+ public:
+  LabelMapFile();
+  ~LabelMapFile();
+
+  bool Open(const std::string &filename);
+  void Close();
+
+  bool IsOpen() const { return m_Data != NULL; }
+  uint64 GetTag() const { return m_Tag; }
+  int GetWidth() const { return m_Width; }
+  int GetHeight() const { return m_Height; }
+  int GetDepth() const { return m_Depth; }
+  int GetNumLabels() const { return m_NumLabels; }
+
+  // Decodes numRows rows (of width labels each, slices stacked) starting
+  // at firstRow into labels. Returns false if a row is malformed or
+  // holds a label outside [0, numLabels).
+  bool DecodeRows(int *labels, int firstRow, int numRows) const;
+
+  // Decodes all width * height * depth labels.
+  bool Decode(int *labels) const {
+    return DecodeRows(labels, 0, m_Height * m_Depth);
+  }
+
+ private:
+  // Not copyable, it owns the mapping
+  LabelMapFile(const LabelMapFile &);
+  LabelMapFile &operator=(const LabelMapFile &);
+
+  const uint8 *m_Data;
+  size_t m_Size;
+#ifdef _MSC_VER
+  void *m_File;
+  void *m_Mapping;
+#endif
+
+  uint64 m_Tag;
+  int m_Width;
+  int m_Height;
+  int m_Depth;
+  int m_NumLabels;
+  int m_LabelBytes;
+  const uint8 *m_Offsets;
+  const uint8 *m_Rows;
+  size_t m_RowsSize;
+};
+
+#endif // _LABEL_MAP_H__
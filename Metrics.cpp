@@ -0,0 +1,176 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#include "Metrics.h"
+#include "JSON.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Allocation counting. Linking this file replaces the global operator new,
+// so that every allocation in the program is counted.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uint64> gAllocatedBytes(0);
+
+// The array and nothrow forms all come through here.
+void *operator new(std::size_t size) {
+  gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  void *p = malloc(size > 0 ? size : 1);
+  if(!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+uint64 Metrics::AllocatedBytes() {
+  return gAllocatedBytes.load(std::memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Metrics
+//
+////////////////////////////////////////////////////////////////////////////////
+
+Metrics &Metrics::Get() {
+  static Metrics metrics;
+  return metrics;
+}
+
+Metrics::Stage &Metrics::FindStage(const char *name) {
+  for(auto &stage : m_Stages) {
+    if(stage.name == name) {
+      return stage;
+    }
+  }
+
+  Stage stage;
+  stage.name = name;
+  stage.calls = 0;
+  stage.ms = 0.0;
+  stage.hasBytes = false;
+  stage.bytes = 0;
+  m_Stages.push_back(stage);
+  return m_Stages.back();
+}
+
+void Metrics::AddStage(const char *name, double ms, uint64 bytes, uint64 calls) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  Stage &stage = FindStage(name);
+  stage.calls += calls;
+  stage.ms += ms;
+  stage.hasBytes = true;
+  stage.bytes += bytes;
+}
+
+void Metrics::AddTiming(const char *name, double ms, uint64 calls) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  Stage &stage = FindStage(name);
+  stage.calls += calls;
+  stage.ms += ms;
+}
+
+void Metrics::AddCounter(const char *name, uint64 value) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for(auto &counter : m_Counters) {
+    if(counter.name == name) {
+      counter.value += value;
+      return;
+    }
+  }
+
+  Counter counter;
+  counter.name = name;
+  counter.value = value;
+  m_Counters.push_back(counter);
+}
+
+bool Metrics::WriteJSON(const std::string &filename) const {
+  FILE *f = fopen(filename.c_str(), "w");
+  if(!f) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  fprintf(f, "{\n  \"stages\": [");
+  for(size_t i = 0; i < m_Stages.size(); i++) {
+    const Stage &stage = m_Stages[i];
+    fprintf(f, "%s\n    { \"name\": ", i ? "," : "");
+    WriteJSONString(f, stage.name.c_str());
+    fprintf(f, ", \"calls\": %llu, \"ms\": %.3f",
+            static_cast<unsigned long long>(stage.calls), stage.ms);
+    if(stage.hasBytes) {
+      fprintf(f, ", \"bytes\": %llu", static_cast<unsigned long long>(stage.bytes));
+    }
+    fprintf(f, " }");
+  }
+
+  fprintf(f, "\n  ],\n  \"counters\": {");
+  for(size_t i = 0; i < m_Counters.size(); i++) {
+    fprintf(f, "%s\n    ", i ? "," : "");
+    WriteJSONString(f, m_Counters[i].name.c_str());
+    fprintf(f, ": %llu", static_cast<unsigned long long>(m_Counters[i].value));
+  }
+  fprintf(f, "\n  }\n}\n");
+
+  return fclose(f) == 0;
+}
@@ -0,0 +1,140 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#ifndef _METRICS_H__
+#define _METRICS_H__
+
+#include "TexCompTypes.h"
+#include "StopWatch.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per stage wall time, call counts and allocations for the sc pipeline,
+// plus named counters, written out as JSON:
+//
+//   { "stages": [ { "name": "load", "calls": 1, "ms": 12.3, "bytes": 4096 },
+//                 ... ],
+//     "counters": { "regions": 4621, ... } }
+//
+// Stages keep the order in which they were first recorded. Bytes are those
+// allocated through operator new by any thread while the stage ran, nested
+// stages included, and are left out for stages that were timed elsewhere.
+class Metrics {
+ public:
+  struct Stage {
+    std::string name;
+    uint64 calls;
+    double ms;
+    bool hasBytes;
+    uint64 bytes;
+  };
+
+  struct Counter {
+    std::string name;
+    uint64 value;
+  };
+
+  // The metrics of this process.
+  static Metrics &Get();
+
+  // Total bytes allocated through operator new so far.
+  static uint64 AllocatedBytes();
+
+  // Adds calls calls to a stage, taking ms milliseconds and allocating
+  // bytes bytes between them.
+  void AddStage(const char *name, double ms, uint64 bytes, uint64 calls = 1);
+
+  // As above, for a stage whose allocations are not known.
+  void AddTiming(const char *name, double ms, uint64 calls = 1);
+
+  void AddCounter(const char *name, uint64 value);
+
+  bool WriteJSON(const std::string &filename) const;
+
+ private:
+  Stage &FindStage(const char *name);
+
+  mutable std::mutex m_Mutex;
+  std::vector<Stage> m_Stages;
+  std::vector<Counter> m_Counters;
+};
+
+// Records a stage from construction to destruction, as calls calls for
+// loops over many items.
+class ScopedStage {
+ public:
+  explicit ScopedStage(const char *name, uint64 calls = 1)
+    : m_Name(name)
+    , m_Calls(calls)
+    , m_Bytes(Metrics::AllocatedBytes()) {
+    m_StopWatch.Start();
+  }
+
+  ~ScopedStage() {
+    m_StopWatch.Stop();
+    Metrics::Get().AddStage(m_Name, m_StopWatch.TimeInMilliseconds(),
+                            Metrics::AllocatedBytes() - m_Bytes, m_Calls);
+  }
+
+ private:
+  ScopedStage(const ScopedStage &);
+  ScopedStage &operator=(const ScopedStage &);
+
+  const char *m_Name;
+  uint64 m_Calls;
+  uint64 m_Bytes;
+  StopWatch m_StopWatch;
+};
+
+#endif // _METRICS_H__
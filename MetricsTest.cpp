@@ -0,0 +1,335 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Metrics.h"
+#include "TexCompTypes.h"
+
+static const char *kMetricsFile = "metrics_test.json";
+static const size_t kBytes = 1 << 20;
+
+// Just enough of a JSON reader to check what Metrics::WriteJSON() writes:
+// it fails on anything that is not valid JSON.
+struct JSONValue {
+  enum Type { eNull, eBool, eNumber, eString, eArray, eObject } type;
+  double number;
+  std::string string;
+  std::vector<JSONValue> elements;
+  std::vector<std::pair<std::string, JSONValue> > members;
+
+  JSONValue() : type(eNull), number(0) { }
+
+  const JSONValue *Find(const std::string &name) const {
+    for(size_t i = 0; i < members.size(); i++) {
+      if(members[i].first == name) {
+        return &members[i].second;
+      }
+    }
+    return NULL;
+  }
+};
+
+class JSONReader {
+ public:
+  explicit JSONReader(const std::string &text) : m_Text(text), m_Pos(0) { }
+
+  bool Read(JSONValue &value) {
+    if(!ReadValue(value)) {
+      return false;
+    }
+    SkipSpace();
+    return m_Pos == m_Text.size();
+  }
+
+ private:
+  void SkipSpace() {
+    while(m_Pos < m_Text.size() && strchr(" \t\r\n", m_Text[m_Pos])) {
+      m_Pos++;
+    }
+  }
+
+  bool Expect(const char c) {
+    SkipSpace();
+    if(m_Pos < m_Text.size() && m_Text[m_Pos] == c) {
+      m_Pos++;
+      return true;
+    }
+    return false;
+  }
+
+  bool ReadString(std::string &s) {
+    if(!Expect('"')) {
+      return false;
+    }
+    s.clear();
+    while(m_Pos < m_Text.size()) {
+      const char c = m_Text[m_Pos++];
+      if(c == '"') {
+        return true;
+      } else if(static_cast<unsigned char>(c) < 0x20) {
+        return false;
+      } else if(c != '\\') {
+        s += c;
+      } else if(m_Pos >= m_Text.size()) {
+        return false;
+      } else if(strchr("\"\\/", m_Text[m_Pos])) {
+        s += m_Text[m_Pos++];
+      } else if(strchr("bfnrt", m_Text[m_Pos])) {
+        s += "\b\f\n\r\t"[strchr("bfnrt", m_Text[m_Pos++]) - "bfnrt"];
+      } else if(m_Text[m_Pos] == 'u' && m_Pos + 5 <= m_Text.size()) {
+        // Only the control characters WriteJSON escapes this way
+        s += static_cast<char>(strtol(m_Text.substr(m_Pos + 1, 4).c_str(), NULL, 16));
+        m_Pos += 5;
+      } else {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  bool ReadValue(JSONValue &value) {
+    SkipSpace();
+    if(m_Pos >= m_Text.size()) {
+      return false;
+    }
+
+    const char c = m_Text[m_Pos];
+    if(c == '{') {
+      value.type = JSONValue::eObject;
+      m_Pos++;
+      if(Expect('}')) {
+        return true;
+      }
+      do {
+        std::pair<std::string, JSONValue> member;
+        if(!ReadString(member.first) || !Expect(':') || !ReadValue(member.second)) {
+          return false;
+        }
+        value.members.push_back(member);
+      } while(Expect(','));
+      return Expect('}');
+    } else if(c == '[') {
+      value.type = JSONValue::eArray;
+      m_Pos++;
+      if(Expect(']')) {
+        return true;
+      }
+      do {
+        value.elements.push_back(JSONValue());
+        if(!ReadValue(value.elements.back())) {
+          return false;
+        }
+      } while(Expect(','));
+      return Expect(']');
+    } else if(c == '"') {
+      value.type = JSONValue::eString;
+      return ReadString(value.string);
+    } else if(m_Text.compare(m_Pos, 4, "true") == 0 || m_Text.compare(m_Pos, 4, "null") == 0) {
+      value.type = c == 't' ? JSONValue::eBool : JSONValue::eNull;
+      m_Pos += 4;
+      return true;
+    } else if(m_Text.compare(m_Pos, 5, "false") == 0) {
+      value.type = JSONValue::eBool;
+      m_Pos += 5;
+      return true;
+    }
+
+    const char *begin = m_Text.c_str() + m_Pos;
+    char *end;
+    value.type = JSONValue::eNumber;
+    value.number = strtod(begin, &end);
+    m_Pos += end - begin;
+    return end != begin;
+  }
+
+  const std::string &m_Text;
+  size_t m_Pos;
+};
+
+static bool ReadMetrics(JSONValue &root) {
+  std::string text;
+  FILE *f = fopen(kMetricsFile, "rb");
+  for(int ch; f && (ch = fgetc(f)) != EOF; ) {
+    text += static_cast<char>(ch);
+  }
+  if(f) {
+    fclose(f);
+  }
+  remove(kMetricsFile);
+  return !text.empty() && JSONReader(text).Read(root) && root.type == JSONValue::eObject;
+}
+
+static const JSONValue *FindStage(const JSONValue &root, const char *name) {
+  const JSONValue *stages = root.Find("stages");
+  for(size_t i = 0; stages && i < stages->elements.size(); i++) {
+    const JSONValue *stageName = stages->elements[i].Find("name");
+    if(stageName && stageName->string == name) {
+      return &stages->elements[i];
+    }
+  }
+  return NULL;
+}
+
+static double StageField(const JSONValue &root, const char *name, const char *field) {
+  const JSONValue *stage = FindStage(root, name);
+  const JSONValue *value = stage ? stage->Find(field) : NULL;
+  return value && value->type == JSONValue::eNumber ? value->number : -1.0;
+}
+
+static bool TestStageBytes() {
+  {
+    ScopedStage stage("metrics.none");
+  }
+
+  // A loop over four items that allocates one buffer between them
+  {
+    ScopedStage stage("metrics.alloc", 4);
+    std::vector<char> buffer(kBytes);
+    buffer[kBytes - 1] = 1;
+  }
+
+  // Nested stages are counted in the outer one too, and allocations on
+  // other threads are counted in whatever stage is running
+  {
+    ScopedStage outer("metrics.outer");
+    {
+      ScopedStage inner("metrics.inner");
+      std::vector<char> buffer(kBytes);
+      buffer[0] = 1;
+    }
+    std::thread worker([]() {
+      std::vector<char> buffer(kBytes);
+      buffer[0] = 1;
+    });
+    worker.join();
+  }
+
+  Metrics::Get().AddTiming("metrics.timed", 1.5, 3);
+  Metrics::Get().AddTiming("metrics.timed", 2.5);
+
+  JSONValue root;
+  bool ok = Metrics::Get().WriteJSON(kMetricsFile) && ReadMetrics(root);
+  ok = ok && StageField(root, "metrics.none", "bytes") == 0.0 &&
+    StageField(root, "metrics.none", "calls") == 1.0;
+  ok = ok && StageField(root, "metrics.alloc", "bytes") == kBytes &&
+    StageField(root, "metrics.alloc", "calls") == 4.0;
+  ok = ok && StageField(root, "metrics.inner", "bytes") == kBytes &&
+    StageField(root, "metrics.outer", "bytes") >= 2 * kBytes &&
+    StageField(root, "metrics.outer", "ms") >= StageField(root, "metrics.inner", "ms");
+
+  // Stages timed elsewhere have no byte count
+  ok = ok && FindStage(root, "metrics.timed") != NULL &&
+    FindStage(root, "metrics.timed")->Find("bytes") == NULL &&
+    StageField(root, "metrics.timed", "calls") == 4.0 &&
+    fabs(StageField(root, "metrics.timed", "ms") - 4.0) < 1e-3;
+
+  std::cout << "Bytes per stage: "
+            << static_cast<uint64>(StageField(root, "metrics.alloc", "bytes")) << " allocated, "
+            << static_cast<uint64>(StageField(root, "metrics.outer", "bytes"))
+            << " with a nested stage and a thread" << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestJSON() {
+  Metrics::Get().AddCounter("metrics.counter", 40);
+  Metrics::Get().AddCounter("metrics.counter", 2);
+  Metrics::Get().AddCounter("metrics.\"quoted\\\"\n", 7);
+  Metrics::Get().AddTiming("metrics.\ttab", 1.0);
+
+  JSONValue root;
+  bool ok = Metrics::Get().WriteJSON(kMetricsFile) && ReadMetrics(root);
+
+  // Stages keep the order they were first recorded in, counters add up,
+  // and names are escaped
+  const JSONValue *stages = ok ? root.Find("stages") : NULL;
+  const JSONValue *counters = ok ? root.Find("counters") : NULL;
+  ok = stages && stages->type == JSONValue::eArray &&
+    counters && counters->type == JSONValue::eObject && root.members.size() == 2;
+
+  const char *kOrder[] = {
+    "metrics.none", "metrics.alloc", "metrics.inner", "metrics.outer", "metrics.timed",
+    "metrics.\ttab"
+  };
+  const size_t numStages = sizeof(kOrder) / sizeof(kOrder[0]);
+  ok = ok && stages->elements.size() == numStages;
+  for(size_t i = 0; ok && i < numStages; i++) {
+    const JSONValue &stage = stages->elements[i];
+    ok = stage.type == JSONValue::eObject && stage.Find("name") &&
+      stage.Find("name")->string == kOrder[i] && stage.Find("calls") && stage.Find("ms");
+  }
+
+  ok = ok && counters->members.size() == 2 &&
+    counters->Find("metrics.counter") && counters->Find("metrics.counter")->number == 42.0 &&
+    counters->Find("metrics.\"quoted\\\"\n") &&
+    counters->Find("metrics.\"quoted\\\"\n")->number == 7.0;
+
+  std::cout << "Metrics JSON: " << (ok ? "valid" : "INVALID") << std::endl << std::endl;
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  ok = TestStageBytes() && ok;
+  ok = TestJSON() && ok;
+
+  std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
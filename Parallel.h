@@ -0,0 +1,206 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#ifndef _PARALLEL_H__
+#define _PARALLEL_H__
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Splits [0, count) into numThreads contiguous ranges and calls
+// fn(thread, begin, end) once per range, each on its own thread. The calling
+// thread runs range zero, so numThreads <= 1 runs everything inline.
+template<typename Fn>
+void ParallelFor(int numThreads, const int count, const Fn &fn) {
+  if(numThreads > count) {
+    numThreads = count;
+  }
+
+  if(numThreads <= 1) {
+    if(count > 0) {
+      fn(0, 0, count);
+    }
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads - 1);
+  for(int t = 1; t < numThreads; t++) {
+    const int begin = static_cast<int>((static_cast<long long>(count) * t) / numThreads);
+    const int end = static_cast<int>((static_cast<long long>(count) * (t + 1)) / numThreads);
+    threads.push_back(std::thread([&fn, t, begin, end]() { fn(t, begin, end); }));
+  }
+
+  fn(0, 0, static_cast<int>(count / numThreads));
+
+  for(auto &thread : threads) {
+    thread.join();
+  }
+}
+
+// Worker threads that stay alive between loops. Run() splits the range
+// exactly like ParallelFor, but steady state calls neither create threads
+// nor allocate. Only one thread may call Run() at a time.
+class WorkerPool {
+ public:
+  WorkerPool()
+    : m_call(NULL), m_fn(NULL), m_numThreads(0), m_count(0)
+    , m_generation(0), m_pending(0), m_stop(false) { }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_all();
+    for(auto &thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  template<typename Fn>
+  void Run(int numThreads, const int count, const Fn &fn) {
+    if(numThreads > count) {
+      numThreads = count;
+    }
+
+    if(numThreads <= 1) {
+      if(count > 0) {
+        fn(0, 0, count);
+      }
+      return;
+    }
+
+    // The calling thread is worker zero
+    while(static_cast<int>(m_threads.size()) < numThreads - 1) {
+      const int t = static_cast<int>(m_threads.size()) + 1;
+      const unsigned generation = m_generation;
+      m_threads.push_back(std::thread([this, t, generation]() { Work(t, generation); }));
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_call = &Invoke<Fn>;
+      m_fn = &fn;
+      m_numThreads = numThreads;
+      m_count = count;
+      m_pending = numThreads - 1;
+      m_generation++;
+    }
+    m_wake.notify_all();
+
+    fn(0, 0, static_cast<int>(count / numThreads));
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_pending == 0; });
+  }
+
+ private:
+  WorkerPool(const WorkerPool &);
+  WorkerPool &operator=(const WorkerPool &);
+
+  template<typename Fn>
+  static void Invoke(const void *fn, int t, int begin, int end) {
+    (*static_cast<const Fn *>(fn))(t, begin, end);
+  }
+
+  void Work(const int t, unsigned generation) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;) {
+      m_wake.wait(lock, [&]() { return m_stop || m_generation != generation; });
+      if(m_stop) {
+        return;
+      }
+
+      generation = m_generation;
+      if(t >= m_numThreads) {
+        continue;
+      }
+
+      void (*call)(const void *, int, int, int) = m_call;
+      const void *fn = m_fn;
+      const int begin = static_cast<int>((static_cast<long long>(m_count) * t) / m_numThreads);
+      const int end = static_cast<int>((static_cast<long long>(m_count) * (t + 1)) / m_numThreads);
+
+      lock.unlock();
+      call(fn, t, begin, end);
+      lock.lock();
+
+      if(--m_pending == 0) {
+        m_done.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+
+  void (*m_call)(const void *, int, int, int);
+  const void *m_fn;
+  int m_numThreads;
+  int m_count;
+  unsigned m_generation;
+  int m_pending;
+  bool m_stop;
+};
+
+// ParallelFor on the threads of a pool
+template<typename Fn>
+void ParallelFor(WorkerPool &pool, int numThreads, const int count, const Fn &fn) {
+  pool.Run(numThreads, count, fn);
+}
+
+#endif // _PARALLEL_H__
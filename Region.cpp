@@ -0,0 +1,344 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#include "Region.h"
+#include "Trace.h"
+#include "YCoCg.h"
+
+#include "Vector4.h"
+using FasTC::Vec4f;
+using FasTC::Pixel;
+using FasTC::YCoCgPixel;
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE4_1__)
+#  include <smmintrin.h>
+#endif
+
+bool GetChromaAxis(const ChromaMoments &m, float &co, float &cg) {
+  // n^2 times the covariance. Each pair of pixels with different chroma
+  // adds at least one to the trace, so unless all pixels match it is at
+  // least n - 1, far above the rounding error of the differences.
+  const double n = static_cast<double>(m.n);
+  const double sco = static_cast<double>(m.co);
+  const double scg = static_cast<double>(m.cg);
+  const double cxx = n * static_cast<double>(m.coco) - sco * sco;
+  const double cyy = n * static_cast<double>(m.cgcg) - scg * scg;
+  const double cxy = n * static_cast<double>(m.cocg) - sco * scg;
+  if(m.n < 2 || cxx + cyy < 0.5 * (n - 1.0)) {
+    co = cg = 0.0f;
+    return false;
+  }
+
+  // The larger eigenvalue is (cxx + cyy) / 2 + root. Of the two ways to
+  // write its eigenvector, take the one that does not cancel.
+  const double half = 0.5 * (cxx - cyy);
+  const double root = sqrt(half * half + cxy * cxy);
+  double x, y;
+  if(root == 0.0) {
+    // Equal variance in every direction, any axis will do.
+    x = y = 1.0;
+  } else if(half >= 0.0) {
+    x = half + root;
+    y = cxy;
+  } else {
+    x = cxy;
+    y = root - half;
+  }
+
+  if(x + y < 0.0 || (x + y == 0.0 && x < 0.0)) {
+    x = -x;
+    y = -y;
+  }
+
+  const double len = sqrt(x * x + y * y);
+  co = static_cast<float>(x / len);
+  cg = static_cast<float>(y / len);
+  return true;
+}
+
+template<typename T>
+static inline T Clamp(const T &a, const T &b, const T &v) {
+  return std::max(a, std::min(v, b));
+}
+
+static uint8 CastChannel(const float &f) {
+  return static_cast<uint8>(f + 0.5f);
+}
+
+static uint8 FloatToChannel(const float &f) {
+  return CastChannel(255.0f * f);
+}
+
+static YCoCgPixel Vec4fToPixel(const Vec4f &v) {
+  YCoCgPixel p;
+  p.Y() = CastChannel(Clamp(0.0f, 255.0f, v[0]));
+  p.Co() = CastChannel(Clamp(0.0f, 255.0f, v[1]));
+  p.Cg() = CastChannel(Clamp(0.0f, 255.0f, v[2]));
+  p.A() = CastChannel(Clamp(0.0f, 255.0f, v[3]));
+  return p;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Region
+//
+////////////////////////////////////////////////////////////////////////////////
+
+double Region::Compress(RegionScratch &scratch) {
+  TraceSpan span("Region::Compress");
+  assert(m_Stats.chroma.n == m_NumPixels);
+  assert(m_Stats.minA >= 255);
+
+  const float n = static_cast<float>(m_Stats.chroma.n);
+  const Vec4f centroid (255.0f, m_Stats.chroma.co / n, m_Stats.chroma.cg / n, 255.0f);
+
+  Vec4f axis (0, 0, 0, 0);
+  const bool hasAxis = GetChromaAxis(m_Stats.chroma, axis[1], axis[2]);
+
+  const float fmin = static_cast<float>(m_Stats.minY);
+  const float fmax = static_cast<float>(m_Stats.maxY);
+
+  // The only pass over the pixels: luma indices, and where each pixel falls
+  // on the chroma axis, which bounds the chroma endpoints.
+  float *projections = scratch.GetProjections(m_NumPixels);
+  float a = hasAxis ? FLT_MAX : 0.0f;
+  float b = hasAxis ? -FLT_MAX : 0.0f;
+  for(uint32 i = 0; i < m_NumPixels; i++) {
+    if(fmax == fmin) {
+      m_LumaInterp[i] = 0;
+    } else {
+      float d = (static_cast<float>(m_Y[i]) - fmin) / (fmax - fmin);
+      assert(0.0f <= d && d <= 1.0f);
+      m_LumaInterp[i] = FloatToChannel(d);
+    }
+
+    if(hasAxis) {
+      float d = (static_cast<float>(m_Co[i]) - centroid[1]) * axis[1] +
+        (static_cast<float>(m_Cg[i]) - centroid[2]) * axis[2];
+      projections[i] = d;
+      a = std::min(d, a);
+      b = std::max(d, b);
+    }
+  }
+
+  m_Endpoints[0] = Vec4fToPixel(centroid + (axis * a));
+  m_Endpoints[1] = Vec4fToPixel(centroid + (axis * b));
+  m_Endpoints[0].Y() = m_Stats.minY;
+  m_Endpoints[1].Y() = m_Stats.maxY;
+
+  for(uint32 i = 0; i < m_NumPixels; i++) {
+    if(b == a) {
+      m_Interp[i] = 0;
+    } else {
+      float nd = (projections[i] - a) / (b - a);
+      assert(0.0f <= nd && nd <= 1.0f);
+      m_Interp[i] = FloatToChannel(nd);
+    }
+  }
+
+  return b - a;
+}
+
+// Blends e0 and e1 by the eight bit weight w, as (e0 * (255 - w) + e1 * w) / 255
+// rounded to nearest. Everything stays within 16 bits: the sum is at most
+// 255 * 255, and (t + (t >> 8)) >> 8 divides t - 128 by 255 with rounding.
+static inline int16 Blend(const int e0, const int e1, const int w) {
+  const int t = e0 * (255 - w) + e1 * w + 128;
+  return static_cast<int16>((t + (t >> 8)) >> 8);
+}
+
+static void BlendChannel(const uint8 *weights, const uint32 n,
+                         const int16 e0, const int16 e1, int16 *out) {
+  uint32 i = 0;
+#if defined(__AVX2__)
+  const __m256i ve0 = _mm256_set1_epi16(e0);
+  const __m256i ve1 = _mm256_set1_epi16(e1);
+  const __m256i full = _mm256_set1_epi16(255);
+  const __m256i half = _mm256_set1_epi16(128);
+  for(; i + 16 <= n; i += 16) {
+    const __m256i w = _mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(weights + i)));
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(ve0, _mm256_sub_epi16(full, w)),
+                                 _mm256_mullo_epi16(ve1, w));
+    t = _mm256_add_epi16(t, half);
+    t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), t);
+  }
+#elif defined(__SSE4_1__)
+  const __m128i ve0 = _mm_set1_epi16(e0);
+  const __m128i ve1 = _mm_set1_epi16(e1);
+  const __m128i full = _mm_set1_epi16(255);
+  const __m128i half = _mm_set1_epi16(128);
+  for(; i + 8 <= n; i += 8) {
+    const __m128i w = _mm_cvtepu8_epi16(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i *>(weights + i)));
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(ve0, _mm_sub_epi16(full, w)),
+                              _mm_mullo_epi16(ve1, w));
+    t = _mm_add_epi16(t, half);
+    t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), t);
+  }
+#endif
+
+  for(; i < n; i++) {
+    out[i] = Blend(e0, e1, weights[i]);
+  }
+}
+
+void Region::Reconstruct(Pixel *image) const {
+  static const uint32 kBatchSize = 64;
+  int16 y[kBatchSize], co[kBatchSize], cg[kBatchSize];
+  uint8 r[kBatchSize], g[kBatchSize], b[kBatchSize];
+
+  const YCoCgPixel &e0 = m_Endpoints[0];
+  const YCoCgPixel &e1 = m_Endpoints[1];
+  const int16 alpha = e0.A();
+  for(uint32 begin = 0; begin < m_NumPixels; begin += kBatchSize) {
+    const uint32 n = std::min(kBatchSize, m_NumPixels - begin);
+    BlendChannel(m_LumaInterp + begin, n, e0.Y(), e1.Y(), y);
+    BlendChannel(m_Interp + begin, n, e0.Co(), e1.Co(), co);
+    BlendChannel(m_Interp + begin, n, e0.Cg(), e1.Cg(), cg);
+    YCoCgToRGB(y, co, cg, n, r, g, b);
+
+    const uint32 *indices = m_PixelIndices + begin;
+    for(uint32 i = 0; i < n; i++) {
+      Pixel &p = image[indices[i]];
+      p.R() = r[i];
+      p.G() = g[i];
+      p.B() = b[i];
+      p.A() = alpha;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// RegionSet
+//
+////////////////////////////////////////////////////////////////////////////////
+
+void RegionSet::CollectPixels(const uint32 *argb, const int *labels,
+                              const uint32 nPixels, const uint32 numLabels) {
+  // Count the pixels of each label...
+  std::vector<uint32> offsets(numLabels + 1, 0);
+  for(uint32 i = 0; i < nPixels; i++) {
+    assert(labels[i] >= 0 && static_cast<uint32>(labels[i]) < numLabels);
+    offsets[labels[i] + 1]++;
+  }
+
+  // ... which places each region right after the one before it.
+  uint32 numRegions = 0;
+  for(uint32 l = 0; l < numLabels; l++) {
+    numRegions += offsets[l + 1] > 0 ? 1 : 0;
+    offsets[l + 1] += offsets[l];
+  }
+
+  std::vector<RegionStats> stats(numLabels);
+  m_Y.resize(nPixels);
+  m_Co.resize(nPixels);
+  m_Cg.resize(nPixels);
+  m_Indices.resize(nPixels);
+  m_Interp.resize(nPixels);
+  m_LumaInterp.resize(nPixels);
+
+  // Convert a block at a time, small enough to stay in cache until its
+  // pixels have been scattered.
+  int16 y[kConvertBlockSize], co[kConvertBlockSize], cg[kConvertBlockSize];
+  for(uint32 blockStart = 0; blockStart < nPixels; blockStart += kConvertBlockSize) {
+    const uint32 blockEnd = std::min(nPixels, blockStart + kConvertBlockSize);
+    RGBToYCoCg(argb + blockStart, blockEnd - blockStart, y, co, cg);
+
+    for(uint32 i = blockStart; i < blockEnd; ) {
+      // Labels come in runs along each row. Sum up a run on its own before
+      // adding it to the stats of its region, rather than updating those in
+      // memory for every pixel.
+      const int label = labels[i];
+      uint32 dst = offsets[label];
+      RegionStats run;
+      for(; i < blockEnd && labels[i] == label; i++, dst++) {
+        const uint32 j = i - blockStart;
+        const int16 a = static_cast<int16>(argb[i] >> 24);
+        m_Y[dst] = y[j];
+        m_Co[dst] = co[j];
+        m_Cg[dst] = cg[j];
+        m_Indices[dst] = i;
+        run.Add(y[j], co[j], cg[j], a);
+      }
+      offsets[label] = dst;
+      stats[label].Add(run);
+    }
+  }
+
+  // The scatter advanced every offset to the end of its region.
+  m_Regions.clear();
+  m_Regions.reserve(numRegions);
+  m_MaxRegionPixels = 0;
+  uint32 begin = 0;
+  for(uint32 l = 0; l < numLabels; l++) {
+    const uint32 end = offsets[l];
+    if(end > begin) {
+      m_Regions.push_back(Region(&m_Y[begin], &m_Co[begin], &m_Cg[begin],
+                                 &m_Indices[begin], &m_Interp[begin],
+                                 &m_LumaInterp[begin], end - begin, stats[l]));
+      m_MaxRegionPixels = std::max(m_MaxRegionPixels, end - begin);
+    }
+    begin = end;
+  }
+}
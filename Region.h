@@ -0,0 +1,273 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#ifndef _REGION_H__
+#define _REGION_H__
+
+#include "TexCompTypes.h"
+#include "Pixel.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// Sums over the chroma of a set of pixels, from which their covariance
+// follows without another pass over them. Chroma channels are integers, so
+// the sums are exact.
+struct ChromaMoments {
+  uint64 n;
+  uint64 co, cg;
+  uint64 coco, cocg, cgcg;
+
+  ChromaMoments() : n(0), co(0), cg(0), coco(0), cocg(0), cgcg(0) { }
+
+  void Add(uint32 pCo, uint32 pCg) {
+    n++;
+    co += pCo;
+    cg += pCg;
+    coco += pCo * pCo;
+    cocg += pCo * pCg;
+    cgcg += pCg * pCg;
+  }
+
+  void Add(const ChromaMoments &m) {
+    n += m.n;
+    co += m.co;
+    cg += m.cg;
+    coco += m.coco;
+    cocg += m.cocg;
+    cgcg += m.cgcg;
+  }
+};
+
+// The direction in the Co/Cg plane along which the chroma varies the most,
+// as the principal eigenvector of the 2x2 covariance in closed form. The
+// axis is normalized and points towards increasing Co + Cg. Returns false if
+// all pixels have the same chroma. Collinear chroma needs no special case:
+// the axis then simply follows the line.
+extern bool GetChromaAxis(const ChromaMoments &moments, float &co, float &cg);
+
+// What Region::Compress needs to know about a region besides its pixels,
+// accumulated one pixel at a time while they are collected.
+struct RegionStats {
+  ChromaMoments chroma;
+  int16 minY, maxY;
+  int16 minA;
+
+  RegionStats() : minY(255), maxY(0), minA(255) { }
+
+  void Add(int16 y, int16 co, int16 cg, int16 a) {
+    chroma.Add(co, cg);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+    minA = std::min(minA, a);
+  }
+
+  void Add(const RegionStats &stats) {
+    chroma.Add(stats.chroma);
+    minY = std::min(minY, stats.minY);
+    maxY = std::max(maxY, stats.maxY);
+    minA = std::min(minA, stats.minA);
+  }
+};
+
+// Scratch memory for fitting regions. It grows to fit the largest region
+// it has seen and is reused from then on, so a thread that keeps one fits
+// any number of regions without touching the heap.
+class RegionScratch {
+ public:
+  explicit RegionScratch(uint32 maxPixels = 0) : m_Projections(maxPixels) { }
+
+  float *GetProjections(uint32 numPixels) {
+    if(m_Projections.size() < numPixels) {
+      m_Projections.resize(numPixels);
+    }
+    return m_Projections.data();
+  }
+
+ private:
+  std::vector<float> m_Projections;
+};
+
+// A superpixel approximated by two endpoints in YCoCg space. Chroma is
+// interpolated along the principal axis of the region and luma between its
+// extremes, each with an eight bit index per pixel.
+class Region {
+ public:
+  Region()
+    : m_Y(NULL), m_Co(NULL), m_Cg(NULL), m_PixelIndices(NULL)
+    , m_Interp(NULL), m_LumaInterp(NULL), m_NumPixels(0) { }
+
+  // The region's pixels, one YCoCg channel per array, their indices in the
+  // image and their interpolation values all live in the buffers of the
+  // RegionSet that collected them.
+  Region(const int16 *y, const int16 *co, const int16 *cg,
+         const uint32 *pixelIndices, uint8 *interp, uint8 *lumaInterp,
+         uint32 numPixels, const RegionStats &stats)
+    : m_Stats(stats), m_Y(y), m_Co(co), m_Cg(cg), m_PixelIndices(pixelIndices)
+    , m_Interp(interp), m_LumaInterp(lumaInterp), m_NumPixels(numPixels) { }
+
+  uint32 NumPixels() const { return m_NumPixels; }
+  const int16 *GetY() const { return m_Y; }
+  const int16 *GetCo() const { return m_Co; }
+  const int16 *GetCg() const { return m_Cg; }
+  const uint32 *GetPixelIndices() const { return m_PixelIndices; }
+  const RegionStats &GetStats() const { return m_Stats; }
+  const FasTC::YCoCgPixel &GetEndpoint(uint32 i) const { return m_Endpoints[i]; }
+  const uint8 *GetInterp() const { return m_Interp; }
+  const uint8 *GetLumaInterp() const { return m_LumaInterp; }
+
+  // Populate m_Endpoints and the interpolation values. Everything but the
+  // indices follows from the region's stats, so this reads the pixels once.
+  // Does not allocate once scratch is large enough for the region.
+  double Compress(RegionScratch &scratch);
+
+  // Writes the approximation of each pixel to its place in image. Weights
+  // are eight bit fixed point, and the pixels are blended and converted to
+  // RGB in batches.
+  void Reconstruct(FasTC::Pixel *image) const;
+
+ private:
+  RegionStats m_Stats;
+  FasTC::YCoCgPixel m_Endpoints[2];
+  const int16 *m_Y;
+  const int16 *m_Co;
+  const int16 *m_Cg;
+  const uint32 *m_PixelIndices;
+  uint8 *m_Interp;
+  uint8 *m_LumaInterp;
+  uint32 m_NumPixels;
+};
+
+// The pixels of an image grouped into one region per label. The labels are
+// counted first, which gives every region an offset into a single set of
+// buffers. A second pass converts the pixels to YCoCg a block at a time and
+// copies each there along with its index in the image, while adding it to
+// the stats of its region. The pixels of a region keep their scanline
+// order.
+class RegionSet {
+ public:
+  RegionSet() : m_MaxRegionPixels(0) { }
+
+  // Pixels are packed as 0xAARRGGBB, like the input to SLIC. Labels must be
+  // in [0, numLabels). Labels without pixels get no region.
+  void CollectPixels(const uint32 *argb, const int *labels,
+                     uint32 nPixels, uint32 numLabels);
+
+  uint32 NumRegions() const { return static_cast<uint32>(m_Regions.size()); }
+  uint32 MaxRegionPixels() const { return m_MaxRegionPixels; }
+  Region &GetRegion(uint32 i) { return m_Regions[i]; }
+  const Region &GetRegion(uint32 i) const { return m_Regions[i]; }
+
+  // Calls fn(thread, region) once for every region, on numThreads threads,
+  // with thread in [0, numThreads) so that each can keep its own scratch
+  // memory. Region sizes vary widely, so rather than splitting the regions
+  // evenly each thread keeps taking the next chunk of consecutive regions
+  // until none are left. A chunk covers at least kMinChunkPixels pixels, so
+  // that small regions are not swamped by the cost of fetching them. Regions
+  // do not share any state, so the result does not depend on numThreads.
+  // The threads belong to a pool kept by the set, so once it has run on
+  // numThreads threads further calls neither create threads nor allocate.
+  template<typename Fn>
+  void ForEachRegion(int numThreads, const Fn &fn);
+
+ private:
+  static const uint32 kMinChunkPixels = 4096;
+  static const uint32 kChunksPerThread = 16;
+  static const uint32 kConvertBlockSize = 1024;
+
+  RegionSet(const RegionSet &);
+  RegionSet &operator=(const RegionSet &);
+
+  std::vector<int16> m_Y;
+  std::vector<int16> m_Co;
+  std::vector<int16> m_Cg;
+  std::vector<uint32> m_Indices;
+  std::vector<uint8> m_Interp;
+  std::vector<uint8> m_LumaInterp;
+  std::vector<Region> m_Regions;
+  uint32 m_MaxRegionPixels;
+
+  WorkerPool m_Pool;
+  std::vector<uint32> m_Chunks;
+};
+
+template<typename Fn>
+void RegionSet::ForEachRegion(int numThreads, const Fn &fn) {
+  const uint32 chunkPixels = std::max(
+    kMinChunkPixels, static_cast<uint32>(m_Indices.size() / (std::max(1, numThreads) * kChunksPerThread)));
+
+  // Chunk c is the regions [m_Chunks[c], m_Chunks[c + 1])
+  m_Chunks.assign(1, 0);
+  uint32 pixels = 0;
+  for(uint32 i = 0; i < NumRegions(); i++) {
+    pixels += m_Regions[i].NumPixels();
+    if(pixels >= chunkPixels || i + 1 == NumRegions()) {
+      m_Chunks.push_back(i + 1);
+      pixels = 0;
+    }
+  }
+
+  const int numChunks = static_cast<int>(m_Chunks.size()) - 1;
+  const int numWorkers = std::min(numThreads, numChunks);
+  std::atomic<int> nextChunk(0);
+  ParallelFor(m_Pool, numWorkers, numWorkers, [&](int t, int, int) {
+    for(int c = nextChunk++; c < numChunks; c = nextChunk++) {
+      for(uint32 i = m_Chunks[c]; i < m_Chunks[c + 1]; i++) {
+        fn(t, m_Regions[i]);
+      }
+    }
+  });
+}
+
+#endif // _REGION_H__
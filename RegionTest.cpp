@@ -0,0 +1,902 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "Region.h"
+#include "YCoCg.h"
+#include "TexCompTypes.h"
+#include "StopWatch.h"
+
+#include "Vector4.h"
+#include "Matrix4x4.h"
+using FasTC::Matrix4x4;
+using FasTC::Pixel;
+using FasTC::Vec4f;
+using FasTC::YCoCgPixel;
+
+// Every heap allocation in the test goes through here, so that the scratch
+// test can check that fitting regions does not allocate.
+static std::atomic<uint32> gNumAllocations(0);
+
+void *operator new(std::size_t size) {
+  gNumAllocations++;
+  void *p = malloc(size > 0 ? size : 1);
+  if(!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+// GCC flags the free() below once it inlines this into library code,
+// although it matches the malloc() in operator new above.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept {
+  free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+// Smooth gradients with some noise, fully opaque
+static void GenerateImage(const int w, const int h, std::vector<Pixel> &pixels) {
+  pixels.resize(w * h);
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      Pixel &p = pixels[y*w + x];
+      p.A() = 255;
+      p.R() = static_cast<int16>((x * 255) / w);
+      p.G() = static_cast<int16>((y * 255) / h);
+      p.B() = static_cast<int16>(std::min(255, ((x + y) & 0x7F) + rand() % 64));
+    }
+  }
+}
+
+// Packed as 0xAARRGGBB, the way sc hands pixels to SLIC and RegionSet
+static std::vector<uint32> PackPixels(const std::vector<Pixel> &pixels) {
+  std::vector<uint32> argb(pixels.size());
+  for(size_t i = 0; i < pixels.size(); i++) {
+    const Pixel &p = pixels[i];
+    argb[i] = (static_cast<uint32>(p.A()) << 24) | (static_cast<uint32>(p.R()) << 16) |
+      (static_cast<uint32>(p.G()) << 8) | static_cast<uint32>(p.B());
+  }
+  return argb;
+}
+
+// Labels of a grid of jittered blocks, roughly what SLIC produces
+static void GenerateLabels(const int w, const int h, const int step,
+                           std::vector<int> &labels, int &numLabels) {
+  const int nx = (w + step - 1) / step;
+  const int ny = (h + step - 1) / step;
+  labels.resize(w * h);
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      const int jx = std::min(nx - 1, std::max(0, (x + (y * 7 / step) % 3 - 1) / step));
+      const int jy = std::min(ny - 1, std::max(0, (y + (x * 5 / step) % 3 - 1) / step));
+      labels[y*w + x] = jy * nx + jx;
+    }
+  }
+  numLabels = nx * ny;
+}
+
+// How the pixels were grouped before RegionSet: a hash map from label to a
+// growing vector of pixels.
+typedef std::unordered_map<uint32, std::vector<Pixel> > PixelMap;
+static void CollectPixelsMap(const Pixel *pixels, const int *labels,
+                             const uint32 nPixels, PixelMap &result) {
+  result.clear();
+  for(uint32 i = 0; i < nPixels; i++) {
+    uint32 label = static_cast<uint32>(labels[i]);
+    if(result.count(label) == 0) {
+      std::vector<Pixel> r;
+      r.push_back(pixels[i]);
+      result.insert(std::make_pair(label, r));
+    } else {
+      result[label].push_back(pixels[i]);
+    }
+  }
+}
+
+// How Region::Compress found its axis before GetChromaAxis: the power
+// method on the 4x4 covariance of the distinct points, if not collinear.
+static Matrix4x4<float> ComputeCovarianceMatrix(
+  const std::vector<Vec4f> &points
+) {
+  Vec4f avg(0, 0, 0, 0);
+  for(const auto &p : points) {
+    avg += p;
+  }
+  avg /= float(points.size());
+
+  std::vector<Vec4f > toPts;
+  toPts.reserve(points.size());
+  for(const auto &p : points) {
+    toPts.push_back(p - avg);
+  }
+
+  Matrix4x4<float> covMatrix;
+  for(uint32 i = 0; i < 4; i++) {
+    for(uint32 j = 0; j <= i; j++) {
+      float sum(0.0);
+      for(uint32 k = 0; k < points.size(); k++) {
+        sum += toPts[k][i] * toPts[k][j];
+      }
+
+      covMatrix(i, j) = sum / float(4 - 1);
+      covMatrix(j, i) = covMatrix(i, j);
+    }
+  }
+
+  return covMatrix;
+}
+
+struct CompareVecs {
+  bool operator()(const Vec4f &v1, const Vec4f &v2) {
+    for(uint32 i = 0; i < 4; i++) {
+      if(v1[i] != v2[i]) {
+        return v1[i] < v2[i];
+      }
+    }
+    return false;
+  }
+};
+
+static uint32 GetPrincipalAxis(const std::vector<Vec4f> &pts, Vec4f &axis) {
+  CompareVecs cv;
+  std::set<Vec4f, CompareVecs> upts(cv);
+  for(const auto &p : pts) {
+    upts.insert(p);
+  }
+
+  if(upts.size() == 1) {
+    axis = Vec4f(0, 0, 0, 0);
+    return 0;
+  }
+
+  std::set<Vec4f, CompareVecs>::const_iterator itr = upts.begin();
+  Vec4f upt0 = *itr;
+  itr++;
+
+  Vec4f dir (*itr - upt0);
+  dir.Normalize();
+  itr++;
+
+  bool collinear = true;
+  for(; itr != upts.end(); itr++) {
+    Vec4f v = (*itr - upt0);
+    if(fabs(fabs(v * dir) - v.Length()) > 1e-7) {
+      collinear = false;
+      break;
+    }
+  }
+
+  if(collinear) {
+    axis = dir;
+    return 0;
+  }
+
+  return ComputeCovarianceMatrix(pts).PowerMethod(axis);
+}
+
+static uint8 CastChannel(const float &f) {
+  return static_cast<uint8>(f + 0.5f);
+}
+
+static YCoCgPixel Vec4fToPixel(const Vec4f &v) {
+  YCoCgPixel p;
+  p.Y() = CastChannel(std::max(0.0f, std::min(v[0], 255.0f)));
+  p.Co() = CastChannel(std::max(0.0f, std::min(v[1], 255.0f)));
+  p.Cg() = CastChannel(std::max(0.0f, std::min(v[2], 255.0f)));
+  p.A() = CastChannel(std::max(0.0f, std::min(v[3], 255.0f)));
+  return p;
+}
+
+static std::vector<Vec4f> ChromaPoints(const Pixel *pixels, const uint32 n) {
+  std::vector<Vec4f> pts(n);
+  for(uint32 i = 0; i < n; i++) {
+    YCoCgPixel p(pixels[i]);
+    pts[i] = Vec4f(255.0f, p.Co(), p.Cg(), 255.0f);
+  }
+  return pts;
+}
+
+// The chroma endpoints Region::Compress chose with GetPrincipalAxis, or
+// false where it took the region to be a single color.
+static bool LegacyEndpoints(const Pixel *pixels, const uint32 n,
+                            YCoCgPixel endpoints[2]) {
+  const std::vector<Vec4f> pts = ChromaPoints(pixels, n);
+  Vec4f centroid (0, 0, 0, 0);
+  for(const auto &p : pts) {
+    centroid += p;
+  }
+  centroid /= pts.size();
+
+  Vec4f axis;
+  if(GetPrincipalAxis(pts, axis) <= 0) {
+    return false;
+  }
+  axis.Normalize();
+
+  float a = FLT_MAX, b = -FLT_MAX;
+  for(const auto &pt : pts) {
+    float d = (pt - centroid).Dot(axis);
+    a = std::min(d, a);
+    b = std::max(d, b);
+  }
+
+  endpoints[0] = Vec4fToPixel(centroid + (axis * a));
+  endpoints[1] = Vec4fToPixel(centroid + (axis * b));
+  return true;
+}
+
+// The pixels of a region, from the image it was collected from
+static std::vector<Pixel> RegionPixels(const Region &r, const std::vector<Pixel> &image) {
+  std::vector<Pixel> pixels(r.NumPixels());
+  for(uint32 j = 0; j < r.NumPixels(); j++) {
+    pixels[j] = image[r.GetPixelIndices()[j]];
+  }
+  return pixels;
+}
+
+// Whether the j-th pixel of a region converts to p
+static bool SameYCoCg(const Region &r, const uint32 j, const Pixel &p) {
+  const YCoCgPixel e(p);
+  return r.GetY()[j] == e.Y() && r.GetCo()[j] == e.Co() && r.GetCg()[j] == e.Cg();
+}
+
+static bool SamePixels(const Pixel *a, const Pixel *b, const uint32 n) {
+  for(uint32 i = 0; i < n; i++) {
+    for(uint32 c = 0; c < 4; c++) {
+      if(a[i][c] != b[i][c]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Whether the regions hold the same pixels as the hash map grouping: they
+// come in label order and keep the pixels in scanline order, and every pixel
+// of the image is in exactly one of them.
+static bool SameAsMap(const RegionSet &regions, PixelMap &expected,
+                      const std::vector<int> &labels,
+                      const std::vector<Pixel> &pixels) {
+  bool ok = regions.NumRegions() == expected.size();
+  std::vector<bool> seen(labels.size(), false);
+  uint32 numSeen = 0;
+  for(uint32 i = 0; ok && i < regions.NumRegions(); i++) {
+    const Region &r = regions.GetRegion(i);
+    const uint32 *indices = r.GetPixelIndices();
+    const uint32 label = static_cast<uint32>(labels[indices[0]]);
+    const std::vector<Pixel> &e = expected[label];
+    ok = r.NumPixels() == e.size();
+    for(uint32 j = 0; ok && j < r.NumPixels(); j++) {
+      ok = static_cast<uint32>(labels[indices[j]]) == label && !seen[indices[j]] &&
+        (j == 0 || indices[j] > indices[j - 1]) &&
+        SamePixels(&e[j], &pixels[indices[j]], 1) && SameYCoCg(r, j, e[j]);
+      seen[indices[j]] = true;
+      numSeen++;
+    }
+  }
+  return ok && numSeen == static_cast<uint32>(labels.size());
+}
+
+static bool TestCollect() {
+  const int w = 97, h = 61;
+  std::vector<Pixel> pixels;
+  std::vector<int> labels;
+  int numLabels;
+  GenerateImage(w, h, pixels);
+  GenerateLabels(w, h, 7, labels, numLabels);
+
+  // Leave some labels empty
+  for(int i = 0; i < w * h; i++) {
+    if(labels[i] % 5 == 3) {
+      labels[i]--;
+    }
+  }
+
+  const std::vector<uint32> argb = PackPixels(pixels);
+  RegionSet regions;
+  regions.CollectPixels(&argb[0], &labels[0], w * h, numLabels);
+
+  PixelMap expected;
+  CollectPixelsMap(&pixels[0], &labels[0], w * h, expected);
+  const bool ok = SameAsMap(regions, expected, labels, pixels);
+
+  std::cout << "Collected " << regions.NumRegions() << " of " << numLabels
+            << " labels: " << (ok ? "match" : "MISMATCH") << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestStats() {
+  const int w = 211, h = 97;
+  std::vector<Pixel> pixels;
+  std::vector<int> labels;
+  int numLabels;
+  GenerateImage(w, h, pixels);
+  GenerateLabels(w, h, 9, labels, numLabels);
+
+  const std::vector<uint32> argb = PackPixels(pixels);
+  RegionSet regions;
+  regions.CollectPixels(&argb[0], &labels[0], w * h, numLabels);
+
+  // The stats gathered during collection match those of each region's pixels
+  bool ok = true;
+  for(uint32 i = 0; ok && i < regions.NumRegions(); i++) {
+    const Region &r = regions.GetRegion(i);
+    RegionStats expected;
+    for(uint32 j = 0; j < r.NumPixels(); j++) {
+      const YCoCgPixel p(pixels[r.GetPixelIndices()[j]]);
+      expected.Add(p.Y(), p.Co(), p.Cg(), p.A());
+    }
+
+    const RegionStats &stats = r.GetStats();
+    ok = stats.chroma.n == r.NumPixels() &&
+      stats.chroma.co == expected.chroma.co && stats.chroma.cg == expected.chroma.cg &&
+      stats.chroma.coco == expected.chroma.coco && stats.chroma.cocg == expected.chroma.cocg &&
+      stats.chroma.cgcg == expected.chroma.cgcg &&
+      stats.minY == expected.minY && stats.maxY == expected.maxY &&
+      stats.minY <= stats.maxY && stats.minA == 255;
+  }
+
+  std::cout << "Region stats from collection: " << (ok ? "match" : "MISMATCH")
+            << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestCollectTime() {
+  const int w = 3840, h = 2160;
+  std::vector<Pixel> pixels;
+  std::vector<int> labels;
+  int numLabels;
+  GenerateImage(w, h, pixels);
+  GenerateLabels(w, h, 8, labels, numLabels);
+
+  // Best of a few runs, with the buffers of both kept between them as they
+  // would be when compressing one texture after another. The hash map keeps
+  // RGBA pixels, while the counting sort converts them to YCoCg as well.
+  const std::vector<uint32> argb = PackPixels(pixels);
+  const int kNumRuns = 3;
+  StopWatch stopwatch;
+  double mapTime = 0.0, denseTime = 0.0;
+  PixelMap map;
+  RegionSet regions;
+  for(int run = 0; run < kNumRuns; run++) {
+    stopwatch.Reset();
+    stopwatch.Start();
+    CollectPixelsMap(&pixels[0], &labels[0], w * h, map);
+    stopwatch.Stop();
+    const double t = stopwatch.TimeInMilliseconds();
+    mapTime = run == 0 ? t : std::min(mapTime, t);
+  }
+
+  for(int run = 0; run < kNumRuns; run++) {
+    stopwatch.Reset();
+    stopwatch.Start();
+    regions.CollectPixels(&argb[0], &labels[0], w * h, numLabels);
+    stopwatch.Stop();
+    const double t = stopwatch.TimeInMilliseconds();
+    denseTime = run == 0 ? t : std::min(denseTime, t);
+  }
+
+  std::cout << "Collecting " << numLabels << " regions of " << w << "x" << h
+            << ": " << mapTime << " ms with a hash map, " << denseTime
+            << " ms with a counting sort" << std::endl << std::endl;
+
+  // The timings are only reported; the result is whether both agree.
+  return SameAsMap(regions, map, labels, pixels);
+}
+
+static bool TestParallel() {
+  const int w = 1920, h = 1080;
+  std::vector<Pixel> pixels, serial(w * h), parallel(w * h);
+  std::vector<int> labels;
+  int numLabels;
+  GenerateImage(w, h, pixels);
+  GenerateLabels(w, h, 8, labels, numLabels);
+
+  // A few large regions among the small ones
+  for(int i = 0; i < w * h / 4; i++) {
+    labels[i] /= 200;
+  }
+
+  const std::vector<uint32> argb = PackPixels(pixels);
+  StopWatch stopwatch;
+  RegionSet serialRegions, parallelRegions;
+  serialRegions.CollectPixels(&argb[0], &labels[0], w * h, numLabels);
+  parallelRegions.CollectPixels(&argb[0], &labels[0], w * h, numLabels);
+
+  stopwatch.Start();
+  RegionScratch serialScratch;
+  for(uint32 i = 0; i < serialRegions.NumRegions(); i++) {
+    serialRegions.GetRegion(i).Compress(serialScratch);
+    serialRegions.GetRegion(i).Reconstruct(&serial[0]);
+  }
+  stopwatch.Stop();
+  const double serialTime = stopwatch.TimeInMilliseconds();
+
+  const int kNumThreads = 4;
+  stopwatch.Reset();
+  stopwatch.Start();
+  std::vector<RegionScratch> scratch(kNumThreads);
+  parallelRegions.ForEachRegion(kNumThreads, [&scratch](int t, Region &r) { r.Compress(scratch[t]); });
+  Pixel *parallelOut = &parallel[0];
+  parallelRegions.ForEachRegion(kNumThreads, [parallelOut](int, Region &r) {
+    r.Reconstruct(parallelOut);
+  });
+  stopwatch.Stop();
+  const double parallelTime = stopwatch.TimeInMilliseconds();
+
+  const bool ok = SamePixels(&serial[0], &parallel[0], w * h) &&
+    !SamePixels(&serial[0], &pixels[0], w * h);
+
+  std::cout << "Compressing " << serialRegions.NumRegions() << " regions: "
+            << serialTime << " ms serially, " << parallelTime << " ms on "
+            << kNumThreads << " threads, " << (ok ? "identical" : "DIFFERENT")
+            << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestScratch() {
+  const int w = 1920, h = 1080;
+  std::vector<Pixel> pixels;
+  std::vector<int> labels;
+  int numLabels;
+  GenerateImage(w, h, pixels);
+  GenerateLabels(w, h, 8, labels, numLabels);
+  for(int i = 0; i < w * h / 4; i++) {
+    labels[i] /= 200;
+  }
+
+  const std::vector<uint32> argb = PackPixels(pixels);
+  RegionSet regions;
+  regions.CollectPixels(&argb[0], &labels[0], w * h, numLabels);
+  std::vector<Pixel> out(w * h);
+
+  // Scratch sized up front never grows; scratch that starts out empty grows
+  // only when a region is larger than any before it.
+  RegionScratch sized(regions.MaxRegionPixels()), empty;
+  uint32 numGrown = 0, largest = 0;
+  for(uint32 i = 0; i < regions.NumRegions(); i++) {
+    const uint32 n = regions.GetRegion(i).NumPixels();
+    numGrown += n > largest ? 1 : 0;
+    largest = std::max(largest, n);
+  }
+
+  uint32 before = gNumAllocations;
+  for(uint32 i = 0; i < regions.NumRegions(); i++) {
+    regions.GetRegion(i).Compress(sized);
+    regions.GetRegion(i).Reconstruct(&out[0]);
+  }
+  const uint32 sizedAllocations = gNumAllocations - before;
+
+  before = gNumAllocations;
+  for(uint32 i = 0; i < regions.NumRegions(); i++) {
+    regions.GetRegion(i).Compress(empty);
+  }
+  const uint32 emptyAllocations = gNumAllocations - before;
+
+  // Once the pool has its threads, compressing and reconstructing on them
+  // allocates nothing either
+  const int kNumThreads = 4;
+  std::vector<RegionScratch> scratch(kNumThreads, RegionScratch(regions.MaxRegionPixels()));
+  Pixel *image = &out[0];
+  regions.ForEachRegion(kNumThreads, [&scratch](int t, Region &r) { r.Compress(scratch[t]); });
+  before = gNumAllocations;
+  regions.ForEachRegion(kNumThreads, [&scratch](int t, Region &r) { r.Compress(scratch[t]); });
+  regions.ForEachRegion(kNumThreads, [image](int, Region &r) { r.Reconstruct(image); });
+  const uint32 pooledAllocations = gNumAllocations - before;
+
+  std::cout << "Allocations fitting " << regions.NumRegions() << " regions: "
+            << sizedAllocations << " with sized scratch, " << emptyAllocations
+            << " with empty scratch, " << pooledAllocations << " on " << kNumThreads
+            << " pooled threads" << std::endl << std::endl;
+  return sizedAllocations == 0 && emptyAllocations <= numGrown && pooledAllocations == 0;
+}
+
+static bool TestRGBToYCoCg() {
+  // Every RGB value, one red at a time, with alpha varying to make sure it
+  // is ignored
+  const uint32 n = 1 << 16;
+  std::vector<uint32> argb(n);
+  std::vector<int16> y(n), co(n), cg(n);
+  bool ok = true;
+  for(uint32 r = 0; ok && r < 256; r++) {
+    for(uint32 i = 0; i < n; i++) {
+      argb[i] = ((i * 37) << 24) | (r << 16) | i;
+    }
+
+    // An odd count to exercise the scalar tail too
+    RGBToYCoCg(&argb[0], n - 3, &y[0], &co[0], &cg[0]);
+    for(uint32 i = 0; ok && i < n - 3; i++) {
+      Pixel p;
+      p.A() = 255;
+      p.R() = static_cast<int16>(r);
+      p.G() = static_cast<int16>(i >> 8);
+      p.B() = static_cast<int16>(i & 0xFF);
+      const YCoCgPixel e(p);
+      ok = e.Y() == y[i] && e.Co() == co[i] && e.Cg() == cg[i];
+    }
+  }
+
+  // Against converting one YCoCgPixel at a time, as regions used to
+  std::vector<Pixel> pixels;
+  GenerateImage(1920, 1080, pixels);
+  const std::vector<uint32> packed = PackPixels(pixels);
+  y.resize(pixels.size());
+  co.resize(pixels.size());
+  cg.resize(pixels.size());
+
+  StopWatch stopwatch;
+  stopwatch.Start();
+  uint32 pixelSum = 0;
+  for(size_t i = 0; i < pixels.size(); i++) {
+    const YCoCgPixel p(pixels[i]);
+    y[i] = p.Y();
+    co[i] = p.Co();
+    cg[i] = p.Cg();
+    pixelSum += y[i] + co[i] + cg[i];
+  }
+  stopwatch.Stop();
+  const double pixelTime = stopwatch.TimeInMilliseconds();
+
+  stopwatch.Reset();
+  stopwatch.Start();
+  RGBToYCoCg(&packed[0], static_cast<uint32>(packed.size()), &y[0], &co[0], &cg[0]);
+  stopwatch.Stop();
+  const double batchTime = stopwatch.TimeInMilliseconds();
+
+  uint32 batchSum = 0;
+  for(size_t i = 0; i < pixels.size(); i++) {
+    batchSum += y[i] + co[i] + cg[i];
+  }
+  ok = ok && batchSum == pixelSum;
+
+  std::cout << "Batched RGB to YCoCg for all 2^24 values: "
+            << (ok ? "match" : "MISMATCH") << "; " << pixels.size() << " pixels in "
+            << pixelTime << " ms one at a time, " << batchTime << " ms batched"
+            << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestYCoCgToRGB() {
+  // Every YCoCg value, one luma at a time
+  std::vector<int16> y(1 << 16), co(1 << 16), cg(1 << 16);
+  std::vector<uint8> r(1 << 16), g(1 << 16), b(1 << 16);
+  bool ok = true;
+  for(int l = 0; ok && l < 256; l++) {
+    for(int i = 0; i < (1 << 16); i++) {
+      y[i] = static_cast<int16>(l);
+      co[i] = static_cast<int16>(i & 0xFF);
+      cg[i] = static_cast<int16>(i >> 8);
+    }
+
+    // An odd count to exercise the scalar tail too
+    YCoCgToRGB(&y[0], &co[0], &cg[0], (1 << 16) - 3, &r[0], &g[0], &b[0]);
+    for(int i = 0; ok && i < (1 << 16) - 3; i++) {
+      YCoCgPixel p;
+      p.Y() = y[i];
+      p.Co() = co[i];
+      p.Cg() = cg[i];
+      p.A() = 255;
+      const Pixel e = p.ToRGBA();
+      ok = e.R() == r[i] && e.G() == g[i] && e.B() == b[i];
+    }
+  }
+
+  std::cout << "Batched YCoCg to RGB for all 2^24 values: "
+            << (ok ? "match" : "MISMATCH") << std::endl << std::endl;
+  return ok;
+}
+
+// The float blend Region::Reconstruct used before fixed point weights
+static Pixel FloatReconstruction(const YCoCgPixel endpoints[2],
+                                 const uint8 interp, const uint8 lumaInterp) {
+  float yd = static_cast<float>(lumaInterp) / 255.0f;
+  float vd = static_cast<float>(interp) / 255.0f;
+
+  YCoCgPixel p = endpoints[0] * (1 - vd) + endpoints[1] * vd;
+  p.Y() = endpoints[0].Y() * (1 - yd) + endpoints[1].Y() * yd;
+  return p.ToRGBA();
+}
+
+static bool TestReconstruct() {
+  const int w = 3840, h = 2160;
+  std::vector<Pixel> pixels, out(w * h), floatOut(w * h);
+  std::vector<int> labels;
+  int numLabels;
+  GenerateImage(w, h, pixels);
+  GenerateLabels(w, h, 8, labels, numLabels);
+
+  const std::vector<uint32> argb = PackPixels(pixels);
+  RegionSet regions;
+  regions.CollectPixels(&argb[0], &labels[0], w * h, numLabels);
+  RegionScratch scratch(regions.MaxRegionPixels());
+  regions.ForEachRegion(1, [&scratch](int, Region &r) { r.Compress(scratch); });
+
+  StopWatch stopwatch;
+  stopwatch.Start();
+  for(uint32 i = 0; i < regions.NumRegions(); i++) {
+    const Region &r = regions.GetRegion(i);
+    const YCoCgPixel endpoints[2] = { r.GetEndpoint(0), r.GetEndpoint(1) };
+    for(uint32 j = 0; j < r.NumPixels(); j++) {
+      floatOut[r.GetPixelIndices()[j]] =
+        FloatReconstruction(endpoints, r.GetInterp()[j], r.GetLumaInterp()[j]);
+    }
+  }
+  stopwatch.Stop();
+  const double floatTime = stopwatch.TimeInMilliseconds();
+
+  stopwatch.Reset();
+  stopwatch.Start();
+  for(uint32 i = 0; i < regions.NumRegions(); i++) {
+    regions.GetRegion(i).Reconstruct(&out[0]);
+  }
+  stopwatch.Stop();
+  const double time = stopwatch.TimeInMilliseconds();
+
+  // Each pixel is its endpoints blended with rounding, through ToRGBA(). The
+  // float blend truncated both of its terms, so the two differ by at most
+  // four per RGB channel on this image, on every SIMD path.
+  bool ok = true;
+  int maxFloatError = 0;
+  for(uint32 i = 0; ok && i < regions.NumRegions(); i++) {
+    const Region &r = regions.GetRegion(i);
+    const YCoCgPixel &e0 = r.GetEndpoint(0);
+    const YCoCgPixel &e1 = r.GetEndpoint(1);
+    for(uint32 j = 0; ok && j < r.NumPixels(); j++) {
+      const int v = r.GetInterp()[j];
+      const int l = r.GetLumaInterp()[j];
+      YCoCgPixel p;
+      p.Y() = static_cast<int16>((e0.Y() * (255 - l) + e1.Y() * l + 127) / 255);
+      p.Co() = static_cast<int16>((e0.Co() * (255 - v) + e1.Co() * v + 127) / 255);
+      p.Cg() = static_cast<int16>((e0.Cg() * (255 - v) + e1.Cg() * v + 127) / 255);
+      p.A() = 255;
+      const Pixel e = p.ToRGBA();
+      const Pixel &o = out[r.GetPixelIndices()[j]];
+      ok = SamePixels(&e, &o, 1);
+
+      const Pixel &f = floatOut[r.GetPixelIndices()[j]];
+      for(uint32 c = 0; c < 4; c++) {
+        maxFloatError = std::max(maxFloatError, abs(f[c] - o[c]));
+      }
+    }
+  }
+
+  std::cout << "Reconstructing " << regions.NumRegions() << " regions: " << floatTime
+            << " ms with float weights, " << time << " ms in fixed point, at most "
+            << maxFloatError << " apart" << std::endl << std::endl;
+  return ok && maxFloatError <= 4;
+}
+
+static bool TestChromaAxis() {
+  float co, cg;
+  ChromaMoments single, line, cross, plane;
+  for(uint32 i = 0; i < 10; i++) {
+    single.Add(40, 200);
+    line.Add(10 + 3 * i, 100 - i);
+    cross.Add(100 + (i % 2 == 0 ? int(i) : 0), 100 + (i % 2 == 1 ? int(i) : 0));
+  }
+  cross.Add(100, 100);
+
+  bool ok = !GetChromaAxis(single, co, cg) && co == 0.0f && cg == 0.0f;
+
+  // Collinear points give the direction of their line
+  ok = ok && GetChromaAxis(line, co, cg) &&
+    fabs(co - 3.0f / sqrtf(10.0f)) < 1e-6f && fabs(cg + 1.0f / sqrtf(10.0f)) < 1e-6f;
+
+  // With a clear principal direction the power method agrees
+  std::vector<Vec4f> pts;
+  for(uint32 i = 0; i < 50; i++) {
+    pts.push_back(Vec4f(255.0f, float(rand() % 256), float(128 + (rand() % 32)), 255.0f));
+  }
+  for(const auto &p : pts) {
+    plane.Add(static_cast<uint32>(p[1]), static_cast<uint32>(p[2]));
+  }
+  Vec4f axis;
+  GetPrincipalAxis(pts, axis);
+  axis.Normalize();
+  ok = ok && GetChromaAxis(plane, co, cg) &&
+    fabs(co - axis[1]) < 1e-4f && fabs(cg - axis[2]) < 1e-4f;
+
+  // Any axis is fine when there is none, as long as it is a unit vector
+  ok = ok && GetChromaAxis(cross, co, cg) && fabs(co * co + cg * cg - 1.0f) < 1e-6f;
+
+  std::cout << "Closed form chroma axis: " << (ok ? "correct" : "WRONG")
+            << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestEndpoints() {
+  const int w = 1920, h = 1080;
+  std::vector<Pixel> pixels;
+  std::vector<int> labels;
+  int numLabels;
+  GenerateImage(w, h, pixels);
+  GenerateLabels(w, h, 8, labels, numLabels);
+
+  // Some regions of two colors, whose chroma is collinear
+  for(int i = 0; i < w * h; i++) {
+    if(labels[i] % 7 == 0) {
+      pixels[i].R() = (i % 3) == 0 ? 200 : 60;
+      pixels[i].G() = 90;
+      pixels[i].B() = (i % 3) == 0 ? 30 : 170;
+    }
+  }
+
+  const std::vector<uint32> argb = PackPixels(pixels);
+  RegionSet regions;
+  regions.CollectPixels(&argb[0], &labels[0], w * h, numLabels);
+  RegionScratch scratch;
+  regions.ForEachRegion(1, [&scratch](int, Region &r) { r.Compress(scratch); });
+
+  uint32 numCompared = 0, numAgreed = 0, numCollinear = 0, numSpanned = 0;
+  for(uint32 i = 0; i < regions.NumRegions(); i++) {
+    const Region &r = regions.GetRegion(i);
+    const YCoCgPixel &e0 = r.GetEndpoint(0);
+    const YCoCgPixel &e1 = r.GetEndpoint(1);
+
+    YCoCgPixel legacy[2];
+    if(LegacyEndpoints(&RegionPixels(r, pixels)[0], r.NumPixels(), legacy)) {
+      numCompared++;
+      const bool agree =
+        abs(e0.Co() - legacy[0].Co()) <= 1 && abs(e0.Cg() - legacy[0].Cg()) <= 1 &&
+        abs(e1.Co() - legacy[1].Co()) <= 1 && abs(e1.Cg() - legacy[1].Cg()) <= 1;
+      numAgreed += agree ? 1 : 0;
+      continue;
+    }
+
+    // The old path flattened collinear chroma to its centroid; the end
+    // points now reach the extremes of the line instead.
+    int minCo = 255, maxCo = 0;
+    for(uint32 j = 0; j < r.NumPixels(); j++) {
+      minCo = std::min<int>(minCo, r.GetCo()[j]);
+      maxCo = std::max<int>(maxCo, r.GetCo()[j]);
+    }
+    if(minCo != maxCo) {
+      numCollinear++;
+      numSpanned += (abs(std::min<int>(e0.Co(), e1.Co()) - minCo) <= 1 &&
+                     abs(std::max<int>(e0.Co(), e1.Co()) - maxCo) <= 1) ? 1 : 0;
+    }
+  }
+
+  std::cout << "Endpoints within one of the power method in " << numAgreed
+            << " of " << numCompared << " regions; " << numSpanned << " of "
+            << numCollinear << " collinear regions spanned" << std::endl << std::endl;
+  return numCompared > 0 && numAgreed * 100 >= numCompared * 99 &&
+    numCollinear > 0 && numSpanned == numCollinear;
+}
+
+static bool TestAxisTime() {
+  const uint32 kSizes[] = { 16, 64, 256, 1024, 4096 };
+  bool ok = true;
+  for(uint32 s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); s++) {
+    const uint32 n = kSizes[s];
+    const uint32 numRegions = (1 << 20) / n;
+    std::vector<std::vector<Vec4f> > regions(numRegions);
+    for(auto &pts : regions) {
+      const int co = rand() % 192, cg = rand() % 192;
+      for(uint32 i = 0; i < n; i++) {
+        pts.push_back(Vec4f(255.0f, float(co + rand() % 64), float(cg + rand() % 32), 255.0f));
+      }
+    }
+
+    StopWatch stopwatch;
+    stopwatch.Start();
+    float legacySum = 0.0f;
+    for(const auto &pts : regions) {
+      Vec4f axis;
+      GetPrincipalAxis(pts, axis);
+      axis.Normalize();
+      legacySum += fabs(axis[1]);
+    }
+    stopwatch.Stop();
+    const double legacyTime = stopwatch.TimeInMilliseconds();
+
+    stopwatch.Reset();
+    stopwatch.Start();
+    float sum = 0.0f;
+    for(const auto &pts : regions) {
+      ChromaMoments moments;
+      for(const auto &p : pts) {
+        moments.Add(static_cast<uint32>(p[1]), static_cast<uint32>(p[2]));
+      }
+      float co, cg;
+      GetChromaAxis(moments, co, cg);
+      sum += fabs(co);
+    }
+    stopwatch.Stop();
+    const double time = stopwatch.TimeInMilliseconds();
+
+    std::cout << numRegions << " regions of " << n << " pixels: " << legacyTime
+              << " ms with the power method, " << time << " ms in closed form"
+              << std::endl;
+    ok = ok && fabs(sum - legacySum) < 1e-2f * numRegions;
+  }
+  std::cout << std::endl;
+  return ok;
+}
+
+int main() {
+  srand(0);
+
+  bool ok = true;
+  ok = TestCollect() && ok;
+  ok = TestStats() && ok;
+  ok = TestCollectTime() && ok;
+  ok = TestParallel() && ok;
+  ok = TestScratch() && ok;
+  ok = TestRGBToYCoCg() && ok;
+  ok = TestYCoCgToRGB() && ok;
+  ok = TestReconstruct() && ok;
+  ok = TestChromaAxis() && ok;
+  ok = TestEndpoints() && ok;
+  ok = TestAxisTime() && ok;
+
+  std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
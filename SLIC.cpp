@@ -23,13 +23,23 @@
 
 #include <cassert>
 #include <cfloat>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <fstream>
 #define _ASSERT assert
 
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE4_1__)
+#  include <smmintrin.h>
+#endif
+
 #include "SLIC.h"
+#include "Parallel.h"
+#include "Trace.h"
 
 // For superpixels
 const int dx4[4] = {-1,  0,  1,  0};
@@ -42,12 +52,188 @@ const int dx10[10] = {-1,  0,  1,  0, -1,  1,  1, -1,  0, 0};
 const int dy10[10] = { 0, -1,  0,  1, -1, -1,  1,  1,  0, 0};
 const int dz10[10] = { 0,  0,  0,  0,  0,  0,  0,  0, -1, 1};
 
+//===========================================================================
+/// ClusterAccumulator
+///
+/// One band's share of the centroid update for clusters [first, first+size).
+/// The LAB sums are kept in fixed point so that merging the bands gives the
+/// same centroids however the rows were split between threads.
+//===========================================================================
+static const double kSigmaScale = double(1 << 24);
+
+template<typename T>
+struct ClusterAccumulator {
+  int                 first;
+  long long           changed;//pixels whose label differs from the last iteration
+  vector<long long>   sigmal;
+  vector<long long>   sigmaa;
+  vector<long long>   sigmab;
+  vector<long long>   sigmax;
+  vector<long long>   sigmay;
+  vector<long long>   sigmaz;//supervoxels only
+  vector<int>         clustersize;
+  vector<int>         moved;//pixels that joined or left, active set iterations only
+  vector<T>           maxlab;
+
+  ClusterAccumulator() : first(0), changed(0) { }
+
+  void Reset(const int& lo, const int& hi) {
+    int n = max(0, hi - lo + 1);
+    first = lo;
+    changed = 0;
+    sigmal.assign(n, 0);
+    sigmaa.assign(n, 0);
+    sigmab.assign(n, 0);
+    sigmax.assign(n, 0);
+    sigmay.assign(n, 0);
+    sigmaz.assign(n, 0);
+    clustersize.assign(n, 0);
+    moved.assign(n, 0);
+    maxlab.assign(n, 0);
+  }
+
+  // Widens the cluster range to cover label, keeping what was summed so far.
+  void Include(const int& label) {
+    const int n = int(clustersize.size());
+    if( n == 0 ) first = label;
+    const int front = max(0, first - label);
+    const int back = max(0, label - (first + n - 1));
+    if( !front && !back ) return;
+    Widen(sigmal, front, back);
+    Widen(sigmaa, front, back);
+    Widen(sigmab, front, back);
+    Widen(sigmax, front, back);
+    Widen(sigmay, front, back);
+    Widen(sigmaz, front, back);
+    Widen(clustersize, front, back);
+    Widen(moved, front, back);
+    Widen(maxlab, front, back);
+    first -= front;
+  }
+
+private:
+  template<typename V>
+  static void Widen(V& v, const int& front, const int& back) {
+    v.insert(v.begin(), front, 0);
+    v.insert(v.end(), back, 0);
+  }
+};
+
+//===========================================================================
+/// SLICWorkspace::Buffers
+///
+/// Everything a segmentation needs besides the caller's image and labels.
+/// Nothing here ever shrinks, and the per band vectors are only added to,
+/// so the inner ones keep their storage when fewer threads are used.
+//===========================================================================
+template<typename T>
+struct SLICWorkspace<T>::Buffers {
+  vector<T>                         lvec;
+  vector<T>                         avec;
+  vector<T>                         bvec;
+  vector<T>                         kseedsl;
+  vector<T>                         kseedsa;
+  vector<T>                         kseedsb;
+  vector<T>                         kseedsx;
+  vector<T>                         kseedsy;
+  vector<T>                         kseedsz;
+  vector<int>                       nlabels;
+
+  //supervoxels: slice pointers into lvec, avec and bvec, and the labels
+  vector<T*>                        lvecvec;
+  vector<T*>                        avecvec;
+  vector<T*>                        bvecvec;
+  vector<int>                       voxellabels;
+
+  //PerformSuperpixelSegmentation_VariableSandM
+  vector<ClusterAccumulator<T> >    partials;
+  vector<double>                    banddisplacement;
+  vector<vector<T> >                distvecs;
+  vector<vector<T> >                distlabs;
+  vector<vector<int> >              prevlabels;
+  vector<T>                         maxlab;
+  vector<int>                       allseeds;
+  vector<int>                       chunkstart;
+  vector<int>                       chunkseeds;
+  vector<int>                       activelist;
+  vector<char>                      active;
+  vector<char>                      clusterchanged;
+  vector<T>                         prevx;
+  vector<T>                         prevy;
+  ClusterAccumulator<T>             totals;
+  vector<vector<int> >              touched;
+  vector<vector<int> >              touchedowners;
+  vector<vector<T> >                touchedlab;
+  vector<int>                       cellstart;
+  vector<int>                       cellseeds;
+  vector<int>                       seedcell;
+
+  //EnforceLabelConnectivity
+  vector<int>                       bandbegin;
+  vector<int>                       bandcomponents;
+  vector<vector<int> >              bandroots;
+  vector<vector<int> >              bandsizes;
+  vector<int>                       firstpixel;
+  vector<int>                       componentsize;
+  vector<int>                       componentlabel;
+
+  //warm start: the labels before connectivity of the last segmentation, and
+  //what it was run with. The seeds and maxlab above are still its own.
+  vector<int>                       warmlabels;
+
+  //PerformSLICO_ForGivenStepSize_Pyramid, levels 1 and up
+  vector<vector<T> >                pyramidl;
+  vector<vector<T> >                pyramida;
+  vector<vector<T> >                pyramidb;
+  vector<vector<int> >              pyramidlabels;
+  int                               warmwidth;
+  int                               warmheight;
+  int                               warmstep;
+  int                               warmk;
+
+  WorkerPool                        pool;
+
+  Buffers() : warmwidth(0), warmheight(0), warmstep(0), warmk(0) {}
+};
+
+// Grows v to at least n elements, never shrinking it
+template<typename V>
+static void GrowTo(V& v, const size_t& n) {
+  if( v.size() < n ) v.resize(n);
+}
+
+template<typename T>
+SLICWorkspace<T>::SLICWorkspace()
+{
+  m_buffers = new Buffers;
+}
+
+template<typename T>
+SLICWorkspace<T>::~SLICWorkspace()
+{
+  delete m_buffers;
+}
+
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
 
-SLIC::SLIC()
+template<typename T>
+SLIC<T>::SLIC()
 {
+  m_depth = 0;
+  m_fastlab = true;
+  m_numthreads = 1;
+  m_maxiterations = 10;
+  m_labelchangethreshold = 0;
+  m_displacementthreshold = 0;
+  m_numitr = 0;
+  m_activeset = false;
+  m_activetolerance = 0;
+  m_warmstart = false;
+  m_warmlabelchange = 0;
+
+  m_workspace = &m_ownworkspace;
   m_lvec = NULL;
   m_avec = NULL;
   m_bvec = NULL;
@@ -57,25 +243,27 @@ SLIC::SLIC()
   m_bvecvec = NULL;
 }
 
-SLIC::~SLIC()
+template<typename T>
+SLIC<T>::~SLIC()
 {
-  if(m_lvec) delete [] m_lvec;
-  if(m_avec) delete [] m_avec;
-  if(m_bvec) delete [] m_bvec;
+}
 
+//===========================================================================
+/// StageClock
+///
+/// Timing of the segmentation stages, see GetStageTimings().
+//===========================================================================
+typedef chrono::steady_clock StageClock;
 
-  if(m_lvecvec) {
-    for( int d = 0; d < m_depth; d++ ) delete [] m_lvecvec[d];
-    delete [] m_lvecvec;
-  }
-  if(m_avecvec) {
-    for( int d = 0; d < m_depth; d++ ) delete [] m_avecvec[d];
-    delete [] m_avecvec;
-  }
-  if(m_bvecvec) {
-    for( int d = 0; d < m_depth; d++ ) delete [] m_bvecvec[d];
-    delete [] m_bvecvec;
-  }
+static inline double MillisecondsSince(const StageClock::time_point& start) {
+  return chrono::duration<double, milli>(StageClock::now() - start).count();
+}
+
+//as above, and traces the stage when tracing is on
+static double EndStage(const char* name, const StageClock::time_point& start) {
+  const StageClock::time_point end = StageClock::now();
+  if( Trace::IsEnabled() ) Trace::Record(name, Trace::ToTraceTime(start), Trace::ToTraceTime(end));
+  return chrono::duration<double, milli>(end - start).count();
 }
 
 //==============================================================================
@@ -83,7 +271,8 @@ SLIC::~SLIC()
 ///
 /// sRGB (D65 illuninant assumption) to XYZ conversion
 //==============================================================================
-void SLIC::RGB2XYZ(
+template<typename T>
+void SLIC<T>::RGB2XYZ(
   const int&      sR,
   const int&      sG,
   const int&      sB,
@@ -120,7 +309,8 @@ void SLIC::RGB2XYZ(
 //===========================================================================
 /// RGB2LAB
 //===========================================================================
-void SLIC::RGB2LAB(const int& sR, const int& sG, const int& sB, double& lval, double& aval, double& bval)
+template<typename T>
+void SLIC<T>::RGB2LAB(const int& sR, const int& sG, const int& sB, double& lval, double& aval, double& bval)
 {
   //------------------------
   // sRGB to XYZ conversion
@@ -163,50 +353,311 @@ void SLIC::RGB2LAB(const int& sR, const int& sG, const int& sB, double& lval, do
   bval = 200.0*(fy-fz);
 }
 
+//==============================================================================
+/// LinearizationTable
+///
+/// The sRGB transfer curve of RGB2XYZ evaluated once for each 8-bit value.
+//==============================================================================
+struct LinearizationTable {
+  double d[256];
+  float  f[256];
+
+  LinearizationTable() {
+    for( int i = 0; i < 256; i++ ) {
+      double v = i/255.0;
+      if(v <= 0.04045)
+        d[i] = v/12.92;
+      else
+        d[i] = pow((v+0.055)/1.055,2.4);
+      f[i] = float(d[i]);
+    }
+  }
+};
+
+static const LinearizationTable& GetLinearizationTable() {
+  static const LinearizationTable table;
+  return table;
+}
+
+// XYZ to LAB constants, see RGB2LAB
+static const double kLABEpsilon = 0.008856;
+static const double kLABKappa   = 903.3;
+static const double kLABXr      = 0.950456;
+static const double kLABZr      = 1.088754;
+
+//==============================================================================
+/// FastCbrt
+///
+/// Cube root from an exponent-thirding bit guess and three Newton steps. Only
+/// meant for the positive, normal inputs RGB2LAB_Fast feeds it.
+//==============================================================================
+static inline double FastCbrt(const double& x) {
+  unsigned long long i;
+  memcpy(&i, &x, sizeof(i));
+  i = i/3 + 0x2A9F7893782DA1CEULL;
+  double y;
+  memcpy(&y, &i, sizeof(y));
+
+  y = (2.0*y + x/(y*y))*(1.0/3.0);
+  y = (2.0*y + x/(y*y))*(1.0/3.0);
+  y = (2.0*y + x/(y*y))*(1.0/3.0);
+  return y;
+}
+
+static inline double LABCurve(const double& t) {
+  if(t > kLABEpsilon)
+    return FastCbrt(t);
+  return (kLABKappa*t + 16.0)/116.0;
+}
+
+#if defined(__AVX2__)
+static inline void StoreLAB(double* dst, const __m256& v) {
+  _mm256_storeu_pd(dst,     _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+  _mm256_storeu_pd(dst + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+static inline void StoreLAB(float* dst, const __m256& v) {
+  _mm256_storeu_ps(dst, v);
+}
+
+static inline __m256 LABCurve(const __m256& t) {
+  const __m256 third = _mm256_set1_ps(1.0f/3.0f);
+  const __m256 two = _mm256_set1_ps(2.0f);
+
+  __m256 guess = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_castps_si256(t)), third);
+  __m256 y = _mm256_castsi256_ps(
+    _mm256_add_epi32(_mm256_cvtps_epi32(guess), _mm256_set1_epi32(0x2A555555)));
+  for( int n = 0; n < 3; n++ ) {
+    y = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(two, y),
+                                    _mm256_div_ps(t, _mm256_mul_ps(y, y))), third);
+  }
+
+  __m256 lin = _mm256_add_ps(_mm256_mul_ps(t, _mm256_set1_ps(float(kLABKappa/116.0))),
+                             _mm256_set1_ps(float(16.0/116.0)));
+  __m256 above = _mm256_cmp_ps(t, _mm256_set1_ps(float(kLABEpsilon)), _CMP_GT_OQ);
+  return _mm256_blendv_ps(lin, y, above);
+}
+#elif defined(__SSE4_1__)
+static inline void StoreLAB(double* dst, const __m128& v) {
+  _mm_storeu_pd(dst,     _mm_cvtps_pd(v));
+  _mm_storeu_pd(dst + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+}
+
+static inline void StoreLAB(float* dst, const __m128& v) {
+  _mm_storeu_ps(dst, v);
+}
+
+static inline __m128 LABCurve(const __m128& t) {
+  const __m128 third = _mm_set1_ps(1.0f/3.0f);
+  const __m128 two = _mm_set1_ps(2.0f);
+
+  __m128 guess = _mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(t)), third);
+  __m128 y = _mm_castsi128_ps(
+    _mm_add_epi32(_mm_cvtps_epi32(guess), _mm_set1_epi32(0x2A555555)));
+  for( int n = 0; n < 3; n++ ) {
+    y = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, y),
+                              _mm_div_ps(t, _mm_mul_ps(y, y))), third);
+  }
+
+  __m128 lin = _mm_add_ps(_mm_mul_ps(t, _mm_set1_ps(float(kLABKappa/116.0))),
+                          _mm_set1_ps(float(16.0/116.0)));
+  __m128 above = _mm_cmpgt_ps(t, _mm_set1_ps(float(kLABEpsilon)));
+  return _mm_blendv_ps(lin, y, above);
+}
+#endif
+
 //===========================================================================
-/// DoRGBtoLABConversion
+/// RGB2LAB_Fast
 ///
-/// For whole image: overlaoded floating point version
+/// Same conversion as RGB2LAB, with the per channel pow() replaced by the
+/// 256 entry table and the cube roots by FastCbrt. The vector kernels work in
+/// single precision and only widen on store for the double instantiation.
 //===========================================================================
-void SLIC::DoRGBtoLABConversion(
-  const unsigned int*&        ubuff,
-  double*&                    lvec,
-  double*&                    avec,
-  double*&                    bvec) {
-  int sz = m_width*m_height;
-  lvec = new double[sz];
-  avec = new double[sz];
-  bvec = new double[sz];
+template<typename T>
+void SLIC<T>::RGB2LAB_Fast(
+  const unsigned int*         ubuff,
+  const int&                  sz,
+  T*                          lvec,
+  T*                          avec,
+  T*                          bvec) {
+  const LinearizationTable& lin = GetLinearizationTable();
+
+  // sRGB to XYZ matrix with the reference white folded in
+  const double mx[3] = { 0.4124564/kLABXr, 0.3575761/kLABXr, 0.1804375/kLABXr };
+  const double my[3] = { 0.2126729,        0.7151522,        0.0721750        };
+  const double mz[3] = { 0.0193339/kLABZr, 0.1191920/kLABZr, 0.9503041/kLABZr };
+
+  int j = 0;
+#if defined(__AVX2__)
+  const __m256i mask = _mm256_set1_epi32(0xFF);
+  for( ; j + 8 <= sz; j += 8 ) {
+    __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ubuff + j));
+    __m256 r = _mm256_i32gather_ps(lin.f, _mm256_and_si256(_mm256_srli_epi32(px, 16), mask), 4);
+    __m256 g = _mm256_i32gather_ps(lin.f, _mm256_and_si256(_mm256_srli_epi32(px,  8), mask), 4);
+    __m256 b = _mm256_i32gather_ps(lin.f, _mm256_and_si256(px, mask), 4);
+
+    __m256 xr = _mm256_add_ps(_mm256_add_ps(
+      _mm256_mul_ps(r, _mm256_set1_ps(float(mx[0]))),
+      _mm256_mul_ps(g, _mm256_set1_ps(float(mx[1])))),
+      _mm256_mul_ps(b, _mm256_set1_ps(float(mx[2]))));
+    __m256 yr = _mm256_add_ps(_mm256_add_ps(
+      _mm256_mul_ps(r, _mm256_set1_ps(float(my[0]))),
+      _mm256_mul_ps(g, _mm256_set1_ps(float(my[1])))),
+      _mm256_mul_ps(b, _mm256_set1_ps(float(my[2]))));
+    __m256 zr = _mm256_add_ps(_mm256_add_ps(
+      _mm256_mul_ps(r, _mm256_set1_ps(float(mz[0]))),
+      _mm256_mul_ps(g, _mm256_set1_ps(float(mz[1])))),
+      _mm256_mul_ps(b, _mm256_set1_ps(float(mz[2]))));
+
+    __m256 fx = LABCurve(xr);
+    __m256 fy = LABCurve(yr);
+    __m256 fz = LABCurve(zr);
+
+    __m256 l = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(116.0f), fy), _mm256_set1_ps(16.0f));
+    __m256 a = _mm256_mul_ps(_mm256_set1_ps(500.0f), _mm256_sub_ps(fx, fy));
+    __m256 bb = _mm256_mul_ps(_mm256_set1_ps(200.0f), _mm256_sub_ps(fy, fz));
+
+    StoreLAB(lvec + j, l);
+    StoreLAB(avec + j, a);
+    StoreLAB(bvec + j, bb);
+  }
+#elif defined(__SSE4_1__)
+  for( ; j + 4 <= sz; j += 4 ) {
+    __m128 r = _mm_set_ps(lin.f[(ubuff[j+3] >> 16) & 0xFF], lin.f[(ubuff[j+2] >> 16) & 0xFF],
+                          lin.f[(ubuff[j+1] >> 16) & 0xFF], lin.f[(ubuff[j  ] >> 16) & 0xFF]);
+    __m128 g = _mm_set_ps(lin.f[(ubuff[j+3] >>  8) & 0xFF], lin.f[(ubuff[j+2] >>  8) & 0xFF],
+                          lin.f[(ubuff[j+1] >>  8) & 0xFF], lin.f[(ubuff[j  ] >>  8) & 0xFF]);
+    __m128 b = _mm_set_ps(lin.f[(ubuff[j+3]      ) & 0xFF], lin.f[(ubuff[j+2]      ) & 0xFF],
+                          lin.f[(ubuff[j+1]      ) & 0xFF], lin.f[(ubuff[j  ]      ) & 0xFF]);
+
+    __m128 xr = _mm_add_ps(_mm_add_ps(
+      _mm_mul_ps(r, _mm_set1_ps(float(mx[0]))),
+      _mm_mul_ps(g, _mm_set1_ps(float(mx[1])))),
+      _mm_mul_ps(b, _mm_set1_ps(float(mx[2]))));
+    __m128 yr = _mm_add_ps(_mm_add_ps(
+      _mm_mul_ps(r, _mm_set1_ps(float(my[0]))),
+      _mm_mul_ps(g, _mm_set1_ps(float(my[1])))),
+      _mm_mul_ps(b, _mm_set1_ps(float(my[2]))));
+    __m128 zr = _mm_add_ps(_mm_add_ps(
+      _mm_mul_ps(r, _mm_set1_ps(float(mz[0]))),
+      _mm_mul_ps(g, _mm_set1_ps(float(mz[1])))),
+      _mm_mul_ps(b, _mm_set1_ps(float(mz[2]))));
+
+    __m128 fx = LABCurve(xr);
+    __m128 fy = LABCurve(yr);
+    __m128 fz = LABCurve(zr);
+
+    __m128 l = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(116.0f), fy), _mm_set1_ps(16.0f));
+    __m128 a = _mm_mul_ps(_mm_set1_ps(500.0f), _mm_sub_ps(fx, fy));
+    __m128 bb = _mm_mul_ps(_mm_set1_ps(200.0f), _mm_sub_ps(fy, fz));
+
+    StoreLAB(lvec + j, l);
+    StoreLAB(avec + j, a);
+    StoreLAB(bvec + j, bb);
+  }
+#endif
+
+  for( ; j < sz; j++ ) {
+    double r = lin.d[(ubuff[j] >> 16) & 0xFF];
+    double g = lin.d[(ubuff[j] >>  8) & 0xFF];
+    double b = lin.d[(ubuff[j]      ) & 0xFF];
+
+    double fx = LABCurve(r*mx[0] + g*mx[1] + b*mx[2]);
+    double fy = LABCurve(r*my[0] + g*my[1] + b*my[2]);
+    double fz = LABCurve(r*mz[0] + g*mz[1] + b*mz[2]);
+
+    lvec[j] = T(116.0*fy-16.0);
+    avec[j] = T(500.0*(fx-fy));
+    bvec[j] = T(200.0*(fy-fz));
+  }
+}
+
+//===========================================================================
+/// ConvertRGBtoLAB
+///
+/// Dispatches to the fast or the reference conversion.
+//===========================================================================
+template<typename T>
+void SLIC<T>::ConvertRGBtoLAB(
+  const unsigned int*         ubuff,
+  const int&                  sz,
+  T*                          lvec,
+  T*                          avec,
+  T*                          bvec) {
+  if(m_fastlab) {
+    RGB2LAB_Fast(ubuff, sz, lvec, avec, bvec);
+    return;
+  }
 
   for( int j = 0; j < sz; j++ ) {
     int r = (ubuff[j] >> 16) & 0xFF;
     int g = (ubuff[j] >>  8) & 0xFF;
     int b = (ubuff[j]      ) & 0xFF;
 
-    RGB2LAB( r, g, b, lvec[j], avec[j], bvec[j] );
+    double l, a, bb;
+    RGB2LAB( r, g, b, l, a, bb );
+    lvec[j] = T(l);
+    avec[j] = T(a);
+    bvec[j] = T(bb);
   }
 }
 
+//===========================================================================
+/// DoRGBtoLABConversion
+///
+/// For whole image: overlaoded floating point version
+//===========================================================================
+template<typename T>
+void SLIC<T>::DoRGBtoLABConversion(
+  const unsigned int*&        ubuff,
+  T*&                         lvec,
+  T*&                         avec,
+  T*&                         bvec) {
+  int sz = m_width*m_height;
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  work.lvec.resize(sz);
+  work.avec.resize(sz);
+  work.bvec.resize(sz);
+  lvec = &work.lvec[0];
+  avec = &work.avec[0];
+  bvec = &work.bvec[0];
+
+  ConvertRGBtoLAB(ubuff, sz, lvec, avec, bvec);
+}
+
 //===========================================================================
 /// DoRGBtoLABConversion
 ///
 /// For whole volume
 //===========================================================================
-void SLIC::DoRGBtoLABConversion(
+template<typename T>
+void SLIC<T>::DoRGBtoLABConversion(
   const unsigned int**&       ubuff,
-  double**&                   lvec,
-  double**&                   avec,
-  double**&                   bvec) {
+  T**&                        lvec,
+  T**&                        avec,
+  T**&                        bvec) {
   int sz = m_width*m_height;
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  work.lvec.resize(sz*m_depth);
+  work.avec.resize(sz*m_depth);
+  work.bvec.resize(sz*m_depth);
+  work.lvecvec.resize(m_depth);
+  work.avecvec.resize(m_depth);
+  work.bvecvec.resize(m_depth);
   for( int d = 0; d < m_depth; d++ ) {
-    for( int j = 0; j < sz; j++ ) {
-      int r = (ubuff[d][j] >> 16) & 0xFF;
-      int g = (ubuff[d][j] >>  8) & 0xFF;
-      int b = (ubuff[d][j]      ) & 0xFF;
+    work.lvecvec[d] = &work.lvec[d*sz];
+    work.avecvec[d] = &work.avec[d*sz];
+    work.bvecvec[d] = &work.bvec[d*sz];
+  }
+  lvec = &work.lvecvec[0];
+  avec = &work.avecvec[0];
+  bvec = &work.bvecvec[0];
 
-      RGB2LAB( r, g, b, lvec[d][j], avec[d][j], bvec[d][j] );
+  ParallelFor(work.pool, m_numthreads, m_depth, [&](int, int dbegin, int dend) {
+    for( int d = dbegin; d < dend; d++ ) {
+      ConvertRGBtoLAB(ubuff[d], sz, lvec[d], avec[d], bvec[d]);
     }
-  }
+  });
 }
 
 //=================================================================================
@@ -215,7 +666,8 @@ void SLIC::DoRGBtoLABConversion(
 /// Internal contour drawing option exists. One only needs to comment the if
 /// statement inside the loop that looks at neighbourhood.
 //=================================================================================
-void SLIC::DrawContoursAroundSegments(
+template<typename T>
+void SLIC<T>::DrawContoursAroundSegments(
   unsigned int*           ubuff,
   const int*              labels,
   const int&              width,
@@ -262,7 +714,8 @@ void SLIC::DrawContoursAroundSegments(
 /// Internal contour drawing option exists. One only needs to comment the if
 /// statement inside the loop that looks at neighbourhood.
 //=================================================================================
-void SLIC::DrawContoursAroundSegmentsTwoColors(
+template<typename T>
+void SLIC<T>::DrawContoursAroundSegmentsTwoColors(
   unsigned int*           img,
   const int*              labels,
   const int&              width,
@@ -326,47 +779,46 @@ void SLIC::DrawContoursAroundSegmentsTwoColors(
 
 
 //==============================================================================
-/// DetectLabEdges
+/// DetectLabEdge
+///
+/// Only PerturbSeeds needs gradients, at the 3x3 pixels around each seed,
+/// so they are worked out there rather than for the whole image.
 //==============================================================================
-void SLIC::DetectLabEdges(
-  const double*               lvec,
-  const double*               avec,
-  const double*               bvec,
-  const int&                  width,
-  const int&                  height,
-  vector<double>&             edges) {
-
-  int sz = width*height;
-
-  edges.resize(sz,0);
-  for( int j = 1; j < height-1; j++ ) {
-    for( int k = 1; k < width-1; k++ ) {
-      int i = j*width+k;
-
-      double dx = (lvec[i-1]-lvec[i+1])*(lvec[i-1]-lvec[i+1]) +
-        (avec[i-1]-avec[i+1])*(avec[i-1]-avec[i+1]) +
-        (bvec[i-1]-bvec[i+1])*(bvec[i-1]-bvec[i+1]);
-
-      double dy = (lvec[i-width]-lvec[i+width])*(lvec[i-width]-lvec[i+width]) +
-        (avec[i-width]-avec[i+width])*(avec[i-width]-avec[i+width]) +
-        (bvec[i-width]-bvec[i+width])*(bvec[i-width]-bvec[i+width]);
-
-      //edges[i] = (sqrt(dx) + sqrt(dy));
-      edges[i] = (dx + dy);
-    }
-  }
+template<typename T>
+T SLIC<T>::DetectLabEdge(
+  const int&                  x,
+  const int&                  y) {
+  //the image border has no gradient
+  if( x < 1 || x >= m_width-1 || y < 1 || y >= m_height-1 ) return 0;
+
+  const int width = m_width;
+  const T* lvec = m_lvec;
+  const T* avec = m_avec;
+  const T* bvec = m_bvec;
+  int i = y*width+x;
+
+  double dx = (lvec[i-1]-lvec[i+1])*(lvec[i-1]-lvec[i+1]) +
+    (avec[i-1]-avec[i+1])*(avec[i-1]-avec[i+1]) +
+    (bvec[i-1]-bvec[i+1])*(bvec[i-1]-bvec[i+1]);
+
+  double dy = (lvec[i-width]-lvec[i+width])*(lvec[i-width]-lvec[i+width]) +
+    (avec[i-width]-avec[i+width])*(avec[i-width]-avec[i+width]) +
+    (bvec[i-width]-bvec[i+width])*(bvec[i-width]-bvec[i+width]);
+
+  //return T(sqrt(dx) + sqrt(dy));
+  return T(dx + dy);
 }
 
 //===========================================================================
 /// PerturbSeeds
 //===========================================================================
-void SLIC::PerturbSeeds(
-  vector<double>&             kseedsl,
-  vector<double>&             kseedsa,
-  vector<double>&             kseedsb,
-  vector<double>&             kseedsx,
-  vector<double>&             kseedsy,
-  const vector<double>&       edges) {
+template<typename T>
+void SLIC<T>::PerturbSeeds(
+  vector<T>&                  kseedsl,
+  vector<T>&                  kseedsa,
+  vector<T>&                  kseedsb,
+  vector<T>&                  kseedsx,
+  vector<T>&                  kseedsy) {
 
   const int dx8[8] = {-1, -1,  0,  1, 1, 1, 0, -1};
   const int dy8[8] = { 0, -1, -1, -1, 0, 1, 1,  1};
@@ -379,14 +831,17 @@ void SLIC::PerturbSeeds(
     int oind = oy*m_width + ox;
 
     int storeind = oind;
+    T storeedge = DetectLabEdge(ox, oy);
     for( int i = 0; i < 8; i++ ) {
       int nx = ox+dx8[i];//new x
       int ny = oy+dy8[i];//new y
 
       if( nx >= 0 && nx < m_width && ny >= 0 && ny < m_height) {
         int nind = ny*m_width + nx;
-        if( edges[nind] < edges[storeind]) {
+        T edge = DetectLabEdge(nx, ny);
+        if( edge < storeedge) {
           storeind = nind;
+          storeedge = edge;
         }
       }
     }
@@ -406,15 +861,15 @@ void SLIC::PerturbSeeds(
 ///
 /// The k seed values are taken as uniform spatial pixel samples.
 //===========================================================================
-void SLIC::GetLABXYSeeds_ForGivenStepSize(
-  vector<double>&             kseedsl,
-  vector<double>&             kseedsa,
-  vector<double>&             kseedsb,
-  vector<double>&             kseedsx,
-  vector<double>&             kseedsy,
+template<typename T>
+void SLIC<T>::GetLABXYSeeds_ForGivenStepSize(
+  vector<T>&                  kseedsl,
+  vector<T>&                  kseedsa,
+  vector<T>&                  kseedsb,
+  vector<T>&                  kseedsx,
+  vector<T>&                  kseedsy,
   const int&                  STEP,
-  const bool&                 perturbseeds,
-  const vector<double>&       edgemag) {
+  const bool&                 perturbseeds) {
 
   int numseeds(0);
   int n(0);
@@ -441,23 +896,96 @@ void SLIC::GetLABXYSeeds_ForGivenStepSize(
   kseedsx.resize(numseeds);
   kseedsy.resize(numseeds);
 
+  //the error per strip is negative when the strips were rounded up, and
+  //truncating it can leave the last seed one pixel past the image
   for( int y = 0; y < ystrips; y++ ) {
     int ye = y*yerrperstrip;
+    int seedy = min(y*STEP+yoff+ye, m_height-1);
     for( int x = 0; x < xstrips; x++ ) {
       int xe = x*xerrperstrip;
-      int i = (y*STEP+yoff+ye)*m_width + (x*STEP+xoff+xe);
+      int seedx = min(x*STEP+xoff+xe, m_width-1);
+      int i = seedy*m_width + seedx;
             
       kseedsl[n] = m_lvec[i];
       kseedsa[n] = m_avec[i];
       kseedsb[n] = m_bvec[i];
-      kseedsx[n] = (x*STEP+xoff+xe);
-      kseedsy[n] = (y*STEP+yoff+ye);
+      kseedsx[n] = seedx;
+      kseedsy[n] = seedy;
       n++;
     }
   }
 
   if(perturbseeds) {
-    PerturbSeeds(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, edgemag);
+    PerturbSeeds(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy);
+  }
+}
+
+//===========================================================================
+/// GetLABXYZSeeds_ForGivenStepSize
+///
+/// The seeds are spread over the volume as GetLABXYSeeds_ForGivenStepSize
+/// spreads them over an image, one layer per STEP slices. A volume thinner
+/// than a step, like a short texture array, gets a single layer in the
+/// middle. They are not perturbed.
+//===========================================================================
+template<typename T>
+void SLIC<T>::GetLABXYZSeeds_ForGivenStepSize(
+  vector<T>&                  kseedsl,
+  vector<T>&                  kseedsa,
+  vector<T>&                  kseedsb,
+  vector<T>&                  kseedsx,
+  vector<T>&                  kseedsy,
+  vector<T>&                  kseedsz,
+  const int&                  STEP) {
+  const int sz = m_width*m_height;
+
+  int xstrips = max(1, int(0.5+double(m_width)/double(STEP)));
+  int ystrips = max(1, int(0.5+double(m_height)/double(STEP)));
+  int zstrips = max(1, int(0.5+double(m_depth)/double(STEP)));
+
+  int xerr = m_width  - STEP*xstrips;
+  int yerr = m_height - STEP*ystrips;
+  int zerr = m_depth  - STEP*zstrips;
+
+  double xerrperstrip = double(xerr)/double(xstrips);
+  double yerrperstrip = double(yerr)/double(ystrips);
+  double zerrperstrip = double(zerr)/double(zstrips);
+
+  int xoff = min(STEP, m_width)/2;
+  int yoff = min(STEP, m_height)/2;
+  int zoff = min(STEP, m_depth)/2;
+  //-------------------------
+  const int numseeds = xstrips*ystrips*zstrips;
+  //-------------------------
+  kseedsl.resize(numseeds);
+  kseedsa.resize(numseeds);
+  kseedsb.resize(numseeds);
+  kseedsx.resize(numseeds);
+  kseedsy.resize(numseeds);
+  kseedsz.resize(numseeds);
+
+  //kept inside the volume as in GetLABXYSeeds_ForGivenStepSize
+  int n(0);
+  for( int z = 0; z < zstrips; z++ ) {
+    int ze = z*zerrperstrip;
+    int seedz = min(z*STEP+zoff+ze, m_depth-1);
+    for( int y = 0; y < ystrips; y++ ) {
+      int ye = y*yerrperstrip;
+      int seedy = min(y*STEP+yoff+ye, m_height-1);
+      for( int x = 0; x < xstrips; x++ ) {
+        int xe = x*xerrperstrip;
+        int seedx = min(x*STEP+xoff+xe, m_width-1);
+        int i = seedz*sz + seedy*m_width + seedx;
+
+        kseedsl[n] = m_lvec[i];
+        kseedsa[n] = m_avec[i];
+        kseedsb[n] = m_bvec[i];
+        kseedsx[n] = seedx;
+        kseedsy[n] = seedy;
+        kseedsz[n] = seedz;
+        n++;
+      }
+    }
   }
 }
 
@@ -466,15 +994,15 @@ void SLIC::GetLABXYSeeds_ForGivenStepSize(
 ///
 /// The k seed values are taken as uniform spatial pixel samples.
 //===========================================================================
-void SLIC::GetLABXYSeeds_ForGivenK(
-  vector<double>&             kseedsl,
-  vector<double>&             kseedsa,
-  vector<double>&             kseedsb,
-  vector<double>&             kseedsx,
-  vector<double>&             kseedsy,
+template<typename T>
+void SLIC<T>::GetLABXYSeeds_ForGivenK(
+  vector<T>&                  kseedsl,
+  vector<T>&                  kseedsa,
+  vector<T>&                  kseedsb,
+  vector<T>&                  kseedsx,
+  vector<T>&                  kseedsy,
   const int&                  K,
-  const bool&                 perturbseeds,
-  const vector<double>&       edgemag) {
+  const bool&                 perturbseeds) {
   int sz = m_width*m_height;
   double step = sqrt(double(sz)/double(K));
   int xoff = step/2;
@@ -510,11 +1038,47 @@ void SLIC::GetLABXYSeeds_ForGivenK(
   }
 
   if(perturbseeds) {
-    PerturbSeeds(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, edgemag);
+    PerturbSeeds(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy);
   }
 }
 
 
+//===========================================================================
+/// BucketSeedsByChunk
+///
+/// Lists, for every chunk of chunkrows rows, the seeds whose window reaches
+/// into it. Within a chunk the seeds keep their order in 'seeds'.
+//===========================================================================
+static const int kChunkPixels = 1 << 15;
+
+template<typename T>
+static void BucketSeedsByChunk(
+  const vector<int>&          seeds,
+  const vector<T>&            kseedsy,
+  const int&                  offset,
+  const int&                  height,
+  const int&                  chunkrows,
+  vector<int>&                chunkstart,
+  vector<int>&                chunkseeds) {
+  const int numchunks = (height + chunkrows - 1)/chunkrows;
+  chunkstart.assign(numchunks + 1, 0);
+  for( size_t s = 0; s < seeds.size(); s++ ) {
+    int y1 = max<int>(0,      kseedsy[seeds[s]]-offset);
+    int y2 = min<int>(height, kseedsy[seeds[s]]+offset);
+    for( int c = y1/chunkrows; y1 < y2 && c <= (y2-1)/chunkrows; c++ ) chunkstart[c+1]++;
+  }
+  for( int c = 0; c < numchunks; c++ ) chunkstart[c+1] += chunkstart[c];
+
+  chunkseeds.resize(chunkstart[numchunks]);
+  for( size_t s = 0; s < seeds.size(); s++ ) {
+    int y1 = max<int>(0,      kseedsy[seeds[s]]-offset);
+    int y2 = min<int>(height, kseedsy[seeds[s]]+offset);
+    for( int c = y1/chunkrows; y1 < y2 && c <= (y2-1)/chunkrows; c++ ) chunkseeds[chunkstart[c]++] = seeds[s];
+  }
+  for( int c = numchunks; c > 0; c-- ) chunkstart[c] = chunkstart[c-1];
+  chunkstart[0] = 0;
+}
+
 //===========================================================================
 /// PerformSuperpixelSegmentation_VariableSandM
 ///
@@ -533,15 +1097,18 @@ void SLIC::GetLABXYSeeds_ForGivenK(
 /// SLICO (or SLIC Zero) dynamically varies only the compactness factor S,
 /// not the step size S.
 //===========================================================================
-void SLIC::PerformSuperpixelSegmentation_VariableSandM(
-  vector<double>&             kseedsl,
-  vector<double>&             kseedsa,
-  vector<double>&             kseedsb,
-  vector<double>&             kseedsx,
-  vector<double>&             kseedsy,
+template<typename T>
+void SLIC<T>::PerformSuperpixelSegmentation_VariableSandM(
+  vector<T>&                  kseedsl,
+  vector<T>&                  kseedsa,
+  vector<T>&                  kseedsb,
+  vector<T>&                  kseedsx,
+  vector<T>&                  kseedsy,
   int*                        klabels,
   const int&                  STEP,
-  const int&                  NUMITR) {
+  const int&                  NUMITR,
+  const bool&                 warmstart,
+  const bool&                 keepmaxlab) {
   int sz = m_width*m_height;
   const int numk = kseedsl.size();
   //double cumerr(99999.9);
@@ -552,166 +1119,971 @@ void SLIC::PerformSuperpixelSegmentation_VariableSandM(
   if(STEP < 10) offset = STEP*1.5;
   //----------------
 
-  vector<double> sigmal(numk, 0);
-  vector<double> sigmaa(numk, 0);
-  vector<double> sigmab(numk, 0);
-  vector<double> sigmax(numk, 0);
-  vector<double> sigmay(numk, 0);
-  vector<int> clustersize(numk, 0);
-  vector<double> inv(numk, 0);//to store 1/clustersize[k] values
-  vector<double> distxy(sz, DBL_MAX);
-  vector<double> distlab(sz, DBL_MAX);
-  vector<double> distvec(sz, DBL_MAX);
-  vector<double> maxlab(numk, 10*10);//THIS IS THE VARIABLE VALUE OF M, just start with 10
-  vector<double> maxxy(numk, STEP*STEP);//THIS IS THE VARIABLE VALUE OF M, just start with 10
-
-  double invxywt = 1.0/(STEP*STEP);//NOTE: this is different from how usual SLIC/LKM works
+  //----------------
+  // Rows are processed in chunks whose distance buffers stay in cache, and
+  // each thread owns a run of consecutive chunks.
+  //----------------
+  const int chunkrows = max(1, kChunkPixels/m_width);
+  const int chunkpixels = chunkrows*m_width;
+  const int numchunks = (m_height + chunkrows - 1)/chunkrows;
+  const int numbands = max(1, min(m_numthreads, numchunks));
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  WorkerPool& pool = work.pool;
+  vector<ClusterAccumulator<T> >& partials = work.partials;
+  vector<double>& banddisplacement = work.banddisplacement;
+  GrowTo(partials, numbands);
+  banddisplacement.assign(numbands, 0);
+
+  //----------------
+  // Previous labels are only kept when the label change criterion is on.
+  // A warm start always has it, its first pass counting the pixels that
+  // changed since the previous frame.
+  //----------------
+  const double labelchangethreshold = warmstart ? max(m_labelchangethreshold, m_warmlabelchange) : m_labelchangethreshold;
+  const bool trackchanges = labelchangethreshold > 0;
+  const T TMAX = numeric_limits<T>::max();
+  vector<vector<T> >& distvecs = work.distvecs;
+  vector<vector<T> >& distlabs = work.distlabs;
+  vector<vector<int> >& prevlabels = work.prevlabels;
+  GrowTo(distvecs, numbands);
+  GrowTo(distlabs, numbands);
+  GrowTo(prevlabels, numbands);
+  for( int t = 0; t < numbands; t++ ) {
+    distvecs[t].resize(chunkpixels);
+    distlabs[t].resize(chunkpixels);
+    if(trackchanges) prevlabels[t].resize(chunkpixels);
+  }
+  vector<T>& maxlab = work.maxlab;
+  if(!warmstart && !keepmaxlab) maxlab.assign(numk, 10*10);//THIS IS THE VARIABLE VALUE OF M, just start with 10
+
+  T invxywt = T(1.0/(STEP*STEP));//NOTE: this is different from how usual SLIC/LKM works
+
+  vector<int>& allseeds = work.allseeds;
+  allseeds.resize(numk);
+  for( int k = 0; k < numk; k++ ) allseeds[k] = k;
+  vector<int>& chunkstart = work.chunkstart;
+  vector<int>& chunkseeds = work.chunkseeds;
+
+  //----------------
+  // Active set state: the clusters scanned in the next iteration, running
+  // cluster sums, and the pixels each band touched in this one.
+  //----------------
+  vector<int>& activelist = work.activelist;
+  vector<char>& active = work.active;
+  vector<char>& clusterchanged = work.clusterchanged;
+  vector<T>& prevx = work.prevx;
+  vector<T>& prevy = work.prevy;
+  ClusterAccumulator<T>& totals = work.totals;
+  activelist.clear();
+  active.assign(m_activeset ? numk : 0, 0);
+  clusterchanged.assign(m_activeset ? numk : 0, 0);
+  prevx.assign(m_activeset ? numk : 0, 0);
+  prevy.assign(m_activeset ? numk : 0, 0);
+  if(m_activeset) totals.Reset(0, numk-1);
+  vector<vector<int> >& touched = work.touched;
+  vector<vector<int> >& touchedowners = work.touchedowners;
+  vector<vector<T> >& touchedlab = work.touchedlab;
+  GrowTo(touched, numbands);
+  GrowTo(touchedowners, numbands);
+  GrowTo(touchedlab, numbands);
+  vector<int>& cellstart = work.cellstart;
+  vector<int>& cellseeds = work.cellseeds;
+  vector<int>& seedcell = work.seedcell;
 
   while( numitr < NUMITR ) {
+    StageClock::time_point itrstart = StageClock::now();
     //------
     //cumerr = 0;
     numitr++;
     //------
 
-    distvec.assign(sz, DBL_MAX);
-    for( int n = 0; n < numk; n++ ) {
-      int y1 = max<int>(0,          kseedsy[n]-offset);
-      int y2 = min<int>(m_height,   kseedsy[n]+offset);
-      int x1 = max<int>(0,          kseedsx[n]-offset);
-      int x2 = min<int>(m_width,    kseedsx[n]+offset);
-
-      for( int y = y1; y < y2; y++ ) {
-        for( int x = x1; x < x2; x++ ) {
-          int i = y*m_width + x;
-          _ASSERT( y < m_height && x < m_width && y >= 0 && x >= 0 );
-
-          double l = m_lvec[i];
-          double a = m_avec[i];
-          double b = m_bvec[i];
-
-          distlab[i] =    (l - kseedsl[n])*(l - kseedsl[n]) +
-            (a - kseedsa[n])*(a - kseedsa[n]) +
-            (b - kseedsb[n])*(b - kseedsb[n]);
-
-          distxy[i] =     (x - kseedsx[n])*(x - kseedsx[n]) +
-            (y - kseedsy[n])*(y - kseedsy[n]);
-
-          //------------------------------------------------------------------------
-          double dist = distlab[i]/maxlab[n] + distxy[i]*invxywt;//only varying m, prettier superpixels
-          //double dist = distlab[i]/maxlab[n] + distxy[i]/maxxy[n];//varying both m and S
-          //------------------------------------------------------------------------
-                    
-          if( dist < distvec[i] ) {
-            distvec[i] = dist;
-            klabels[i]  = n;
+    if( m_activeset && numitr > 1 ) {
+      BucketSeedsByChunk(activelist, kseedsy, offset, m_height, chunkrows, chunkstart, chunkseeds);
+      //-----------------------------------------------------------------
+      // Only the windows of active clusters are scanned. The first visit
+      // to a pixel in a chunk is seeded with the distance to the cluster
+      // that owns it, and the pixel is recorded with that owner.
+      //-----------------------------------------------------------------
+      ParallelFor(pool, numbands, numchunks, [&](int t, int cbegin, int cend) {
+        TraceSpan span("slic.assign");
+        vector<int>& pixels = touched[t];
+        vector<int>& owners = touchedowners[t];
+        vector<T>& labs = touchedlab[t];
+        pixels.clear();
+        owners.clear();
+        labs.clear();
+        T* distvec = &distvecs[t][0];
+        T* distlab = &distlabs[t][0];
+
+        for( int c = cbegin; c < cend; c++ ) {
+          if( chunkstart[c] == chunkstart[c+1] ) continue;
+          const int ybegin = c*chunkrows;
+          const int yend = min(m_height, ybegin + chunkrows);
+          const int base = ybegin*m_width;
+          fill(distvec, distvec + (yend - ybegin)*m_width, TMAX);
+          const size_t chunkfirst = pixels.size();
+
+          for( int s = chunkstart[c]; s < chunkstart[c+1]; s++ ) {
+            const int n = chunkseeds[s];
+            int y1 = max<int>(ybegin,     kseedsy[n]-offset);
+            int y2 = min<int>(yend,       kseedsy[n]+offset);
+            int x1 = max<int>(0,          kseedsx[n]-offset);
+            int x2 = min<int>(m_width,    kseedsx[n]+offset);
+
+            for( int y = y1; y < y2; y++ ) {
+              for( int x = x1; x < x2; x++ ) {
+                int i = y*m_width + x;
+                int p = i - base;
+
+                T l = m_lvec[i];
+                T a = m_avec[i];
+                T b = m_bvec[i];
+
+                if( distvec[p] == TMAX ) {
+                  const int o = klabels[i];
+                  _ASSERT(o >= 0);
+                  distlab[p] =  (l - kseedsl[o])*(l - kseedsl[o]) +
+                    (a - kseedsa[o])*(a - kseedsa[o]) +
+                    (b - kseedsb[o])*(b - kseedsb[o]);
+                  T dxy =       (x - kseedsx[o])*(x - kseedsx[o]) +
+                    (y - kseedsy[o])*(y - kseedsy[o]);
+                  distvec[p] = distlab[p]/maxlab[o] + dxy*invxywt;
+                  pixels.push_back(i);
+                  owners.push_back(o);
+                  if( o == n ) continue;
+                }
+
+                T dl =  (l - kseedsl[n])*(l - kseedsl[n]) +
+                  (a - kseedsa[n])*(a - kseedsa[n]) +
+                  (b - kseedsb[n])*(b - kseedsb[n]);
+                T dxy = (x - kseedsx[n])*(x - kseedsx[n]) +
+                  (y - kseedsy[n])*(y - kseedsy[n]);
+                T dist = dl/maxlab[n] + dxy*invxywt;
+
+                if( dist < distvec[p] ) {
+                  distvec[p] = dist;
+                  distlab[p] = dl;
+                  klabels[i] = n;
+                }
+              }
+            }
+          }
+          for( size_t j = chunkfirst; j < pixels.size(); j++ ) {
+            labs.push_back(distlab[pixels[j] - base]);
           }
         }
-      }
+
+        //-----------------------------------------------------------------
+        // Per band deltas: maxima from the winning seed of every touched
+        // pixel, and sums moved from the old owner to the new one.
+        //-----------------------------------------------------------------
+        ClusterAccumulator<T>& acc = partials[t];
+        int lo(numk), hi(-1);
+        for( size_t j = 0; j < pixels.size(); j++ ) {
+          lo = min(lo, min(owners[j], klabels[pixels[j]]));
+          hi = max(hi, max(owners[j], klabels[pixels[j]]));
+        }
+        acc.Reset(lo, hi);
+
+        for( size_t j = 0; j < pixels.size(); j++ ) {
+          const int i = pixels[j];
+          const int k = klabels[i] - acc.first;
+          if(acc.maxlab[k] < labs[j]) acc.maxlab[k] = labs[j];
+          if( klabels[i] == owners[j] ) continue;
+
+          const int o = owners[j] - acc.first;
+          const long long l = (long long)(m_lvec[i]*kSigmaScale);
+          const long long a = (long long)(m_avec[i]*kSigmaScale);
+          const long long b = (long long)(m_bvec[i]*kSigmaScale);
+          const int x = i % m_width;
+          const int y = i / m_width;
+          acc.sigmal[o] -= l; acc.sigmal[k] += l;
+          acc.sigmaa[o] -= a; acc.sigmaa[k] += a;
+          acc.sigmab[o] -= b; acc.sigmab[k] += b;
+          acc.sigmax[o] -= x; acc.sigmax[k] += x;
+          acc.sigmay[o] -= y; acc.sigmay[k] += y;
+          acc.clustersize[o]--; acc.clustersize[k]++;
+          acc.moved[o]++; acc.moved[k]++;
+          acc.changed++;
+        }
+      });
+      //-----------------------------------------------------------------
+      // Fold the deltas into the running sums and move only the seeds of
+      // clusters that gained or lost pixels.
+      //-----------------------------------------------------------------
+      banddisplacement.assign(numbands, 0);
+      ParallelFor(pool, numbands, numk, [&](int t, int kbegin, int kend) {
+        TraceSpan span("slic.update");
+        for( int k = kbegin; k < kend; k++ ) {
+          int moved(0);
+          bool grown(false);
+          for( int b = 0; b < numbands; b++ ) {
+            const ClusterAccumulator<T>& acc = partials[b];
+            int j = k - acc.first;
+            if( j < 0 || j >= int(acc.clustersize.size()) ) continue;
+
+            //a larger maximum rescales every distance to the cluster
+            if(maxlab[k] < acc.maxlab[j]) { maxlab[k] = acc.maxlab[j]; grown = true; }
+            totals.sigmal[k] += acc.sigmal[j];
+            totals.sigmaa[k] += acc.sigmaa[j];
+            totals.sigmab[k] += acc.sigmab[j];
+            totals.sigmax[k] += acc.sigmax[j];
+            totals.sigmay[k] += acc.sigmay[j];
+            totals.clustersize[k] += acc.clustersize[j];
+            moved += acc.moved[j];
+          }
+          clusterchanged[k] = grown;
+          if( !moved && !grown ) continue;
+
+          int clustersize = totals.clustersize[k];
+          if( clustersize <= 0 ) clustersize = 1;
+          double inv = 1.0/double(clustersize);
+          T newx = T(double(totals.sigmax[k])*inv);
+          T newy = T(double(totals.sigmay[k])*inv);
+          double dx = newx - kseedsx[k];
+          double dy = newy - kseedsy[k];
+
+          //-----------------------------------------------------------------
+          // A seed that moved less than the tolerance stays where it is;
+          // the running sums keep the drift until it adds up.
+          //-----------------------------------------------------------------
+          if( !grown && dx*dx + dy*dy < m_activetolerance*m_activetolerance ) continue;
+          clusterchanged[k] = 1;
+          banddisplacement[t] = max(banddisplacement[t], dx*dx + dy*dy);
+
+          prevx[k] = kseedsx[k];
+          prevy[k] = kseedsy[k];
+          kseedsl[k] = T(double(totals.sigmal[k])*inv/kSigmaScale);
+          kseedsa[k] = T(double(totals.sigmaa[k])*inv/kSigmaScale);
+          kseedsb[k] = T(double(totals.sigmab[k])*inv/kSigmaScale);
+          kseedsx[k] = newx;
+          kseedsy[k] = newy;
+        }
+      });
+    } else {
+      BucketSeedsByChunk(allseeds, kseedsy, offset, m_height, chunkrows, chunkstart, chunkseeds);
+      //-----------------------------------------------------------------
+      // Each thread visits, chunk by chunk, every seed whose window
+      // overlaps the chunk, in seed order, so the result is the serial
+      // one. The color distance kept for a pixel is that of the last
+      // seed to scan it, and is folded into the max color distance of
+      // the pixel's cluster together with the centroid sums while the
+      // chunk is still in cache.
+      //-----------------------------------------------------------------
+      ParallelFor(pool, numbands, numchunks, [&](int t, int cbegin, int cend) {
+        TraceSpan span("slic.assign");
+        ClusterAccumulator<T>& acc = partials[t];
+        T* distvec = &distvecs[t][0];
+        T* distlab = &distlabs[t][0];
+
+        int lo(numk), hi(-1);
+        for( int s = chunkstart[cbegin]; s < chunkstart[cend]; s++ ) {
+          lo = min(lo, chunkseeds[s]);
+          hi = max(hi, chunkseeds[s]);
+        }
+        acc.Reset(lo, hi);
+
+        for( int c = cbegin; c < cend; c++ ) {
+          const int ybegin = c*chunkrows;
+          const int yend = min(m_height, ybegin + chunkrows);
+          const int base = ybegin*m_width;
+          const int count = (yend - ybegin)*m_width;
+          fill(distvec, distvec + count, TMAX);
+          if(trackchanges) {
+            copy(klabels + base, klabels + base + count, prevlabels[t].begin());
+          }
+
+          for( int s = chunkstart[c]; s < chunkstart[c+1]; s++ ) {
+            const int n = chunkseeds[s];
+            int y1 = max<int>(ybegin,     kseedsy[n]-offset);
+            int y2 = min<int>(yend,       kseedsy[n]+offset);
+            int x1 = max<int>(0,          kseedsx[n]-offset);
+            int x2 = min<int>(m_width,    kseedsx[n]+offset);
+
+            for( int y = y1; y < y2; y++ ) {
+              for( int x = x1; x < x2; x++ ) {
+                int i = y*m_width + x;
+                int p = i - base;
+                _ASSERT( y < m_height && x < m_width && y >= 0 && x >= 0 );
+
+                T l = m_lvec[i];
+                T a = m_avec[i];
+                T b = m_bvec[i];
+
+                distlab[p] =    (l - kseedsl[n])*(l - kseedsl[n]) +
+                  (a - kseedsa[n])*(a - kseedsa[n]) +
+                  (b - kseedsb[n])*(b - kseedsb[n]);
+
+                T distxy =      (x - kseedsx[n])*(x - kseedsx[n]) +
+                  (y - kseedsy[n])*(y - kseedsy[n]);
+
+                //------------------------------------------------------------------------
+                T dist = distlab[p]/maxlab[n] + distxy*invxywt;//only varying m, prettier superpixels
+                //double dist = distlab[i]/maxlab[n] + distxy[i]/maxxy[n];//varying both m and S
+                //------------------------------------------------------------------------
+
+                if( dist < distvec[p] ) {
+                  distvec[p] = dist;
+                  klabels[i]  = n;
+                }
+              }
+            }
+          }
+
+          if(trackchanges) {
+            for( int p = 0; p < count; p++ ) {
+              if(klabels[base + p] != prevlabels[t][p]) acc.changed++;
+            }
+          }
+
+          //-----------------------------------------------------------------
+          // Colors are summed over runs of equal labels along a row and only
+          // the run totals are converted to fixed point.
+          //-----------------------------------------------------------------
+          int i = base;
+          for( int y = ybegin; y < yend; y++ ) {
+            int x = 0;
+            while( x < m_width ) {
+              const int label = klabels[i];
+              _ASSERT(label >= 0);
+              acc.Include(label);
+              const int k = label - acc.first;
+              double runl(0), runa(0), runb(0);
+              int runstart = x;
+              for( ; x < m_width && klabels[i] == label; x++, i++ ) {
+                //pixels no window reached keep their label and add no distance
+                if(distvec[i - base] != TMAX && acc.maxlab[k] < distlab[i - base]) acc.maxlab[k] = distlab[i - base];
+                runl += m_lvec[i];
+                runa += m_avec[i];
+                runb += m_bvec[i];
+              }
+              int runlength = x - runstart;
+              acc.sigmal[k] += (long long)(runl*kSigmaScale);
+              acc.sigmaa[k] += (long long)(runa*kSigmaScale);
+              acc.sigmab[k] += (long long)(runb*kSigmaScale);
+              acc.sigmax[k] += (long long)(runstart + x - 1)*runlength/2;
+              acc.sigmay[k] += (long long)y*runlength;
+              acc.clustersize[k] += runlength;
+            }
+          }
+        }
+      });
+      //-----------------------------------------------------------------
+      // Merge the bands and store the new centroids in the seed values
+      //-----------------------------------------------------------------
+      banddisplacement.assign(numbands, 0);
+      ParallelFor(pool, numbands, numk, [&](int t, int kbegin, int kend) {
+        TraceSpan span("slic.update");
+        for( int k = kbegin; k < kend; k++ ) {
+          long long sigmal(0), sigmaa(0), sigmab(0), sigmax(0), sigmay(0);
+          int clustersize(0);
+          for( int b = 0; b < numbands; b++ ) {
+            const ClusterAccumulator<T>& acc = partials[b];
+            int j = k - acc.first;
+            if( j < 0 || j >= int(acc.clustersize.size()) ) continue;
+
+            if(maxlab[k] < acc.maxlab[j]) maxlab[k] = acc.maxlab[j];
+            sigmal += acc.sigmal[j];
+            sigmaa += acc.sigmaa[j];
+            sigmab += acc.sigmab[j];
+            sigmax += acc.sigmax[j];
+            sigmay += acc.sigmay[j];
+            clustersize += acc.clustersize[j];
+          }
+
+          if(m_activeset) {
+            totals.sigmal[k] = sigmal;
+            totals.sigmaa[k] = sigmaa;
+            totals.sigmab[k] = sigmab;
+            totals.sigmax[k] = sigmax;
+            totals.sigmay[k] = sigmay;
+            totals.clustersize[k] = clustersize;
+            clusterchanged[k] = 1;
+            prevx[k] = kseedsx[k];
+            prevy[k] = kseedsy[k];
+          }
+
+          //_ASSERT(clustersize > 0);
+          if( clustersize <= 0 ) clustersize = 1;
+          double inv = 1.0/double(clustersize);//computing inverse now to multiply, than divide later
+          T newx = T(double(sigmax)*inv);
+          T newy = T(double(sigmay)*inv);
+          double dx = newx - kseedsx[k];
+          double dy = newy - kseedsy[k];
+          banddisplacement[t] = max(banddisplacement[t], dx*dx + dy*dy);
+
+          kseedsl[k] = T(double(sigmal)*inv/kSigmaScale);
+          kseedsa[k] = T(double(sigmaa)*inv/kSigmaScale);
+          kseedsb[k] = T(double(sigmab)*inv/kSigmaScale);
+          kseedsx[k] = newx;
+          kseedsy[k] = newy;
+        }
+      });
     }
     //-----------------------------------------------------------------
-    // Assign the max color distance for a cluster
+    // Next active set: every cluster that changed plus every cluster
+    // whose window overlaps the old or the new window of one that did.
+    // Seeds are bucketed on a grid of window sized cells to find them.
     //-----------------------------------------------------------------
-    if(0 == numitr) {
-      maxlab.assign(numk,1);
-      maxxy.assign(numk,1);
-    } {for( int i = 0; i < sz; i++ ) {
-        if(maxlab[klabels[i]] < distlab[i]) maxlab[klabels[i]] = distlab[i];
-        if(maxxy[klabels[i]] < distxy[i]) maxxy[klabels[i]] = distxy[i];
-      }}
+    if(m_activeset) {
+      const int reach = 2*offset;
+      const int gridw = m_width/reach + 1;
+      const int gridh = m_height/reach + 1;
+      cellstart.assign(gridw*gridh + 1, 0);
+      cellseeds.resize(numk);
+      seedcell.resize(numk);
+      for( int k = 0; k < numk; k++ ) {
+        int cx = min(gridw-1, max(0, int(kseedsx[k])/reach));
+        int cy = min(gridh-1, max(0, int(kseedsy[k])/reach));
+        seedcell[k] = cy*gridw + cx;
+        cellstart[seedcell[k] + 1]++;
+      }
+      for( int c = 0; c < gridw*gridh; c++ ) cellstart[c+1] += cellstart[c];
+      for( int k = 0; k < numk; k++ ) cellseeds[cellstart[seedcell[k]]++] = k;
+      for( int c = gridw*gridh; c > 0; c-- ) cellstart[c] = cellstart[c-1];
+      cellstart[0] = 0;
+
+      active.assign(numk, 0);
+      for( int k = 0; k < numk; k++ ) {
+        if( !clusterchanged[k] ) continue;
+        active[k] = 1;
+        T x1 = min(prevx[k], kseedsx[k]) - reach;
+        T x2 = max(prevx[k], kseedsx[k]) + reach;
+        T y1 = min(prevy[k], kseedsy[k]) - reach;
+        T y2 = max(prevy[k], kseedsy[k]) + reach;
+        int cx1 = max(0, int(x1)/reach - 1), cx2 = min(gridw-1, int(x2)/reach + 1);
+        int cy1 = max(0, int(y1)/reach - 1), cy2 = min(gridh-1, int(y2)/reach + 1);
+        for( int cy = cy1; cy <= cy2; cy++ ) {
+          for( int cx = cx1; cx <= cx2; cx++ ) {
+            const int c = cy*gridw + cx;
+            for( int j = cellstart[c]; j < cellstart[c+1]; j++ ) {
+              const int s = cellseeds[j];
+              if( kseedsx[s] > x1 && kseedsx[s] < x2 &&
+                  kseedsy[s] > y1 && kseedsy[s] < y2 ) active[s] = 1;
+            }
+          }
+        }
+      }
+      activelist.clear();
+      for( int k = 0; k < numk; k++ ) {
+        if(active[k]) activelist.push_back(k);
+      }
+    }
     //-----------------------------------------------------------------
-    // Recalculate the centroid and store in the seed values
+    // Stop early once labels or centroids have settled
     //-----------------------------------------------------------------
-    sigmal.assign(numk, 0);
-    sigmaa.assign(numk, 0);
-    sigmab.assign(numk, 0);
-    sigmax.assign(numk, 0);
-    sigmay.assign(numk, 0);
-    clustersize.assign(numk, 0);
-
-    for( int j = 0; j < sz; j++ ) {
-      _ASSERT(klabels[j] >= 0);
-      sigmal[klabels[j]] += m_lvec[j];
-      sigmaa[klabels[j]] += m_avec[j];
-      sigmab[klabels[j]] += m_bvec[j];
-      sigmax[klabels[j]] += (j%m_width);
-      sigmay[klabels[j]] += (j/m_width);
-
-      clustersize[klabels[j]]++;
-    } {for( int k = 0; k < numk; k++ ) {
-        //_ASSERT(clustersize[k] > 0);
-        if( clustersize[k] <= 0 ) clustersize[k] = 1;
-        inv[k] = 1.0/double(clustersize[k]);//computing inverse now to multiply, than divide later
-      }} {for( int k = 0; k < numk; k++ ) {
-        kseedsl[k] = sigmal[k]*inv[k];
-        kseedsa[k] = sigmaa[k]*inv[k];
-        kseedsb[k] = sigmab[k]*inv[k];
-        kseedsx[k] = sigmax[k]*inv[k];
-        kseedsy[k] = sigmay[k]*inv[k];
-      }}
+    long long changed(0);
+    double displacement(0);
+    for( int t = 0; t < numbands; t++ ) {
+      changed += partials[t].changed;
+      displacement = max(displacement, banddisplacement[t]);
+    }
+    displacement = sqrt(displacement);
+    m_stagetimings.iterations.push_back(EndStage("slic.iteration", itrstart));
+
+    if( m_activeset && activelist.empty() ) break;
+    if( trackchanges && double(changed) < labelchangethreshold*sz ) break;
+    if( m_displacementthreshold > 0 && displacement < m_displacementthreshold ) break;
   }
+  m_numitr = numitr;
 }
 
 //===========================================================================
-/// SaveSuperpixelLabels
+/// BucketSeedsByVolumeChunk
 ///
-/// Save labels in raster scan order.
+/// BucketSeedsByChunk for volumes, where chunk c is the chunkrows rows from
+/// row (c%rowchunks)*chunkrows of slice c/rowchunks.
 //===========================================================================
-static inline void _splitpath(
-  const char *path, char *ignored, char *ignoredAgain, char *fname, char *ext
-) {
-  // Go to the end
-  const char *end = path;
-  while(*(++end) != '\0');
+template<typename T>
+static void BucketSeedsByVolumeChunk(
+  const vector<T>&            kseedsy,
+  const vector<T>&            kseedsz,
+  const int&                  offset,
+  const int&                  height,
+  const int&                  depth,
+  const int&                  chunkrows,
+  vector<int>&                chunkstart,
+  vector<int>&                chunkseeds) {
+  const int rowchunks = (height + chunkrows - 1)/chunkrows;
+  const int numchunks = depth*rowchunks;
+  const int numk = kseedsy.size();
+  chunkstart.assign(numchunks + 1, 0);
+  for( int pass = 0; pass < 2; pass++ ) {
+    for( int n = 0; n < numk; n++ ) {
+      int y1 = max<int>(0,      kseedsy[n]-offset);
+      int y2 = min<int>(height, kseedsy[n]+offset);
+      int z1 = max<int>(0,      kseedsz[n]-offset);
+      int z2 = min<int>(depth,  kseedsz[n]+offset);
+      for( int z = z1; y1 < y2 && z < z2; z++ ) {
+        for( int c = z*rowchunks + y1/chunkrows; c <= z*rowchunks + (y2-1)/chunkrows; c++ ) {
+          if( pass == 0 ) chunkstart[c+1]++;
+          else chunkseeds[chunkstart[c]++] = n;
+        }
+      }
+    }
+    if( pass == 0 ) {
+      for( int c = 0; c < numchunks; c++ ) chunkstart[c+1] += chunkstart[c];
+      chunkseeds.resize(chunkstart[numchunks]);
+    }
+  }
+  for( int c = numchunks; c > 0; c-- ) chunkstart[c] = chunkstart[c-1];
+  chunkstart[0] = 0;
+}
 
-  // Go backwards until you hit the extension separator
-  while(*(--end) != '.');
-  strcpy(ext, end + 1);
+//===========================================================================
+/// PerformSupervoxelSegmentation_VariableSandM
+///
+/// PerformSuperpixelSegmentation_VariableSandM for volumes, with full
+/// iterations only. The distance adds the slice offset to the spatial term,
+/// and a chunk is some rows of one slice, so a band of chunks may span
+/// slices and the work splits between threads however few slices there are.
+//===========================================================================
+template<typename T>
+void SLIC<T>::PerformSupervoxelSegmentation_VariableSandM(
+  vector<T>&                  kseedsl,
+  vector<T>&                  kseedsa,
+  vector<T>&                  kseedsb,
+  vector<T>&                  kseedsx,
+  vector<T>&                  kseedsy,
+  vector<T>&                  kseedsz,
+  int*                        klabels,
+  const int&                  STEP,
+  const int&                  NUMITR) {
+  const int sz = m_width*m_height;
+  const int numvoxels = sz*m_depth;
+  const int numk = kseedsl.size();
+  int numitr(0);
 
-  // Save this position
-  const char *extSep = end;
+  //----------------
+  int offset = STEP;
+  if(STEP < 10) offset = STEP*1.5;
+  //----------------
+
+  const int chunkrows = max(1, min(m_height, kChunkPixels/m_width));
+  const int chunkpixels = chunkrows*m_width;
+  const int rowchunks = (m_height + chunkrows - 1)/chunkrows;
+  const int numchunks = m_depth*rowchunks;
+  const int numbands = max(1, min(m_numthreads, numchunks));
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  WorkerPool& pool = work.pool;
+  vector<ClusterAccumulator<T> >& partials = work.partials;
+  vector<double>& banddisplacement = work.banddisplacement;
+  GrowTo(partials, numbands);
+  banddisplacement.assign(numbands, 0);
+
+  const bool trackchanges = m_labelchangethreshold > 0;
+  const T TMAX = numeric_limits<T>::max();
+  vector<vector<T> >& distvecs = work.distvecs;
+  vector<vector<T> >& distlabs = work.distlabs;
+  vector<vector<int> >& prevlabels = work.prevlabels;
+  GrowTo(distvecs, numbands);
+  GrowTo(distlabs, numbands);
+  GrowTo(prevlabels, numbands);
+  for( int t = 0; t < numbands; t++ ) {
+    distvecs[t].resize(chunkpixels);
+    distlabs[t].resize(chunkpixels);
+    if(trackchanges) prevlabels[t].resize(chunkpixels);
+  }
+  vector<T>& maxlab = work.maxlab;
+  maxlab.assign(numk, 10*10);//THIS IS THE VARIABLE VALUE OF M, just start with 10
+
+  T invxywt = T(1.0/(STEP*STEP));
+  vector<int>& chunkstart = work.chunkstart;
+  vector<int>& chunkseeds = work.chunkseeds;
+
+  while( numitr < NUMITR ) {
+    StageClock::time_point itrstart = StageClock::now();
+    numitr++;
+
+    BucketSeedsByVolumeChunk(kseedsy, kseedsz, offset, m_height, m_depth, chunkrows, chunkstart, chunkseeds);
+    //-----------------------------------------------------------------
+    // As for images: seeds are visited chunk by chunk in seed order, and
+    // the sums and color maxima are taken while the chunk is in cache.
+    //-----------------------------------------------------------------
+    ParallelFor(pool, numbands, numchunks, [&](int t, int cbegin, int cend) {
+      TraceSpan span("slic.assign");
+      ClusterAccumulator<T>& acc = partials[t];
+      T* distvec = &distvecs[t][0];
+      T* distlab = &distlabs[t][0];
+
+      int lo(numk), hi(-1);
+      for( int s = chunkstart[cbegin]; s < chunkstart[cend]; s++ ) {
+        lo = min(lo, chunkseeds[s]);
+        hi = max(hi, chunkseeds[s]);
+      }
+      acc.Reset(lo, hi);
+
+      for( int c = cbegin; c < cend; c++ ) {
+        const int z = c/rowchunks;
+        const int ybegin = (c%rowchunks)*chunkrows;
+        const int yend = min(m_height, ybegin + chunkrows);
+        const int base = z*sz + ybegin*m_width;
+        const int count = (yend - ybegin)*m_width;
+        fill(distvec, distvec + count, TMAX);
+        if(trackchanges) {
+          copy(klabels + base, klabels + base + count, prevlabels[t].begin());
+        }
+
+        for( int s = chunkstart[c]; s < chunkstart[c+1]; s++ ) {
+          const int n = chunkseeds[s];
+          int y1 = max<int>(ybegin,     kseedsy[n]-offset);
+          int y2 = min<int>(yend,       kseedsy[n]+offset);
+          int x1 = max<int>(0,          kseedsx[n]-offset);
+          int x2 = min<int>(m_width,    kseedsx[n]+offset);
+          const T distz = (z - kseedsz[n])*(z - kseedsz[n]);
+
+          for( int y = y1; y < y2; y++ ) {
+            for( int x = x1; x < x2; x++ ) {
+              int p = (y - ybegin)*m_width + x;
+              int i = base + p;
+
+              T l = m_lvec[i];
+              T a = m_avec[i];
+              T b = m_bvec[i];
 
-  // Keep going backwards until you hit a path separator
-  while(*(--end) != '\\' && *end != '/');
-  strncpy(fname, end + 1, extSep - (end + 1));
+              distlab[p] =    (l - kseedsl[n])*(l - kseedsl[n]) +
+                (a - kseedsa[n])*(a - kseedsa[n]) +
+                (b - kseedsb[n])*(b - kseedsb[n]);
+
+              T distxyz =     (x - kseedsx[n])*(x - kseedsx[n]) +
+                (y - kseedsy[n])*(y - kseedsy[n]) + distz;
+
+              T dist = distlab[p]/maxlab[n] + distxyz*invxywt;
+
+              if( dist < distvec[p] ) {
+                distvec[p] = dist;
+                klabels[i]  = n;
+              }
+            }
+          }
+        }
+
+        if(trackchanges) {
+          for( int p = 0; p < count; p++ ) {
+            if(klabels[base + p] != prevlabels[t][p]) acc.changed++;
+          }
+        }
+
+        int i = base;
+        for( int y = ybegin; y < yend; y++ ) {
+          int x = 0;
+          while( x < m_width ) {
+            const int label = klabels[i];
+            _ASSERT(label >= 0);
+            acc.Include(label);
+            const int k = label - acc.first;
+            double runl(0), runa(0), runb(0);
+            int runstart = x;
+            for( ; x < m_width && klabels[i] == label; x++, i++ ) {
+              if(distvec[i - base] != TMAX && acc.maxlab[k] < distlab[i - base]) acc.maxlab[k] = distlab[i - base];
+              runl += m_lvec[i];
+              runa += m_avec[i];
+              runb += m_bvec[i];
+            }
+            int runlength = x - runstart;
+            acc.sigmal[k] += (long long)(runl*kSigmaScale);
+            acc.sigmaa[k] += (long long)(runa*kSigmaScale);
+            acc.sigmab[k] += (long long)(runb*kSigmaScale);
+            acc.sigmax[k] += (long long)(runstart + x - 1)*runlength/2;
+            acc.sigmay[k] += (long long)y*runlength;
+            acc.sigmaz[k] += (long long)z*runlength;
+            acc.clustersize[k] += runlength;
+          }
+        }
+      }
+    });
+    //-----------------------------------------------------------------
+    // Merge the bands and store the new centroids in the seed values
+    //-----------------------------------------------------------------
+    banddisplacement.assign(numbands, 0);
+    ParallelFor(pool, numbands, numk, [&](int t, int kbegin, int kend) {
+      TraceSpan span("slic.update");
+      for( int k = kbegin; k < kend; k++ ) {
+        long long sigmal(0), sigmaa(0), sigmab(0), sigmax(0), sigmay(0), sigmaz(0);
+        int clustersize(0);
+        for( int b = 0; b < numbands; b++ ) {
+          const ClusterAccumulator<T>& acc = partials[b];
+          int j = k - acc.first;
+          if( j < 0 || j >= int(acc.clustersize.size()) ) continue;
+
+          if(maxlab[k] < acc.maxlab[j]) maxlab[k] = acc.maxlab[j];
+          sigmal += acc.sigmal[j];
+          sigmaa += acc.sigmaa[j];
+          sigmab += acc.sigmab[j];
+          sigmax += acc.sigmax[j];
+          sigmay += acc.sigmay[j];
+          sigmaz += acc.sigmaz[j];
+          clustersize += acc.clustersize[j];
+        }
+
+        if( clustersize <= 0 ) clustersize = 1;
+        double inv = 1.0/double(clustersize);
+        T newx = T(double(sigmax)*inv);
+        T newy = T(double(sigmay)*inv);
+        T newz = T(double(sigmaz)*inv);
+        double dx = newx - kseedsx[k];
+        double dy = newy - kseedsy[k];
+        double dz = newz - kseedsz[k];
+        banddisplacement[t] = max(banddisplacement[t], dx*dx + dy*dy + dz*dz);
+
+        kseedsl[k] = T(double(sigmal)*inv/kSigmaScale);
+        kseedsa[k] = T(double(sigmaa)*inv/kSigmaScale);
+        kseedsb[k] = T(double(sigmab)*inv/kSigmaScale);
+        kseedsx[k] = newx;
+        kseedsy[k] = newy;
+        kseedsz[k] = newz;
+      }
+    });
+
+    //-----------------------------------------------------------------
+    // Stop early once labels or centroids have settled
+    //-----------------------------------------------------------------
+    long long changed(0);
+    double displacement(0);
+    for( int t = 0; t < numbands; t++ ) {
+      changed += partials[t].changed;
+      displacement = max(displacement, banddisplacement[t]);
+    }
+    displacement = sqrt(displacement);
+    m_stagetimings.iterations.push_back(EndStage("slic.iteration", itrstart));
+
+    if( trackchanges && double(changed) < m_labelchangethreshold*numvoxels ) break;
+    if( m_displacementthreshold > 0 && displacement < m_displacementthreshold ) break;
+  }
+  m_numitr = numitr;
 }
 
-void SLIC::SaveSuperpixelLabels(
+//===========================================================================
+/// SaveSuperpixelLabels
+///
+/// Save labels in raster scan order, as native ints in one write. The
+/// file is named after filename without its directory and extension.
+//===========================================================================
+template<typename T>
+void SLIC<T>::SaveSuperpixelLabels(
   const int*                  labels,
   const int&                  width,
   const int&                  height,
   const string&               filename,
   const string&               path)  {
-  int sz = width*height;
+  size_t sz = size_t(width)*height;
 
-  static const int _MAX_FNAME = 256;
-  char fname[_MAX_FNAME];
-  char extn[_MAX_FNAME];
-  _splitpath(filename.c_str(), NULL, NULL, fname, extn);
-  string temp = fname;
+  string fname = filename;
+  size_t sep = fname.find_last_of("\\/");
+  if( sep != string::npos ) fname = fname.substr(sep + 1);
+  size_t dot = fname.find_last_of('.');
+  if( dot != string::npos ) fname = fname.substr(0, dot);
 
   ofstream outfile;
-  string finalpath = path + temp + string(".dat");
+  string finalpath = path + fname + string(".dat");
   outfile.open(finalpath.c_str(), ios::binary);
-  for( int i = 0; i < sz; i++ ) {
-    outfile.write((const char*)&labels[i], sizeof(int));
-  }
+  outfile.write((const char*)labels, sz*sizeof(int));
   outfile.close();
 }
 
 //===========================================================================
-/// EnforceLabelConnectivity
+/// FindRoot
+///
+/// Union-find root with path halving. Sets are always merged towards the
+/// smaller root, so every parent pointer goes to a smaller index.
+//===========================================================================
+static int FindRoot(int* parent, int i) {
+  while( parent[i] != i ) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+//without path compression, for when only roots may be written
+static int PeekRoot(const int* parent, int i) {
+  while( parent[i] != i ) i = parent[i];
+  return i;
+}
+
+static void Unite(int* parent, const int& a, const int& b) {
+  int ra = FindRoot(parent, a);
+  int rb = FindRoot(parent, b);
+  if( ra < rb ) parent[rb] = ra;
+  else if( rb < ra ) parent[ra] = rb;
+}
+
+//===========================================================================
+/// RelabelComponents
 ///
 ///     1. finding an adjacent label for each new component at the start
 ///     2. if a certain component is too small, assigning the previously found
 ///         adjacent label to this component, and not incrementing the label.
+///
+/// Components are found with a union-find per band of rows, one band per
+/// thread, followed by a merge across the band boundaries, using nlabels
+/// as the parent array. Components are then numbered by their first pixel
+/// in raster order, which is the order the original flood fill visited
+/// them in, so the adjacent label and the absorption of small segments
+/// are decided exactly as before, once per component rather than per pixel.
+///
+/// A row is a row of an image, or a whole slice of a volume; the only
+/// neighbour a pixel has in the row before its own is the one right above.
 //===========================================================================
-void SLIC::EnforceLabelConnectivity(
+template<typename T>
+template<typename UniteRows, typename Neighbours>
+void SLIC<T>::RelabelComponents(
+  const int*                  labels,
+  const int&                  rowsize,
+  const int&                  numrows,
+  int*                        nlabels,
+  int&                        numlabels,
+  const int&                  SUPSZ,
+  const int&                  numthreads,
+  const UniteRows&            uniterows,
+  const Neighbours&           neighbours)
+{
+  const int numbands = max(1, min(numthreads, numrows));
+  int* parent = nlabels;
+
+  //-------------------------------------------------------
+  // Union-find within each band. Roots are the first pixel of their
+  // set, so one raster pass points every pixel at its band root.
+  //-------------------------------------------------------
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  WorkerPool& pool = work.pool;
+  vector<int>& bandbegin = work.bandbegin;
+  vector<vector<int> >& bandroots = work.bandroots;
+  bandbegin.assign(numbands + 1, numrows);
+  GrowTo(bandroots, numbands);
+  ParallelFor(pool, numbands, numrows, [&](int t, int ybegin, int yend) {
+    TraceSpan span("slic.unite");
+    bandbegin[t] = ybegin;
+    uniterows(ybegin, yend);
+    vector<int>& roots = bandroots[t];
+    roots.clear();
+    for( int i = ybegin*rowsize; i < yend*rowsize; i++ ) {
+      parent[i] = parent[parent[i]];
+      if( parent[i] == i ) roots.push_back(i);
+    }
+  });
+
+  //-------------------------------------------------------
+  // Merge across band boundaries linking roots only, then point every
+  // band root at its final root, in raster order.
+  //-------------------------------------------------------
+  for( int t = 1; t < numbands; t++ ) {
+    for( int i = bandbegin[t]*rowsize; i < (bandbegin[t] + 1)*rowsize; i++ ) {
+      if( labels[i-rowsize] != labels[i] ) continue;
+      int ra = PeekRoot(parent, i);
+      int rb = PeekRoot(parent, i-rowsize);
+      if( ra < rb ) parent[rb] = ra;
+      else if( rb < ra ) parent[ra] = rb;
+    }
+  }
+  vector<int>& bandcomponents = work.bandcomponents;
+  bandcomponents.assign(numbands + 1, 0);
+  for( int t = 0; t < numbands; t++ ) {
+    const vector<int>& roots = bandroots[t];
+    for( size_t j = 0; j < roots.size(); j++ ) {
+      parent[roots[j]] = parent[parent[roots[j]]];
+      if( parent[roots[j]] == roots[j] ) bandcomponents[t+1]++;
+    }
+  }
+  for( int t = 0; t < numbands; t++ ) bandcomponents[t+1] += bandcomponents[t];
+  const int numcomponents = bandcomponents[numbands];
+
+  //-------------------------------------------------------
+  // Number the components by their first pixel. Roots hold -(id+1)
+  // until every other pixel has read its id from its root.
+  //-------------------------------------------------------
+  vector<int>& firstpixel = work.firstpixel;
+  vector<int>& componentsize = work.componentsize;
+  firstpixel.resize(numcomponents);
+  componentsize.assign(numcomponents, 0);
+  ParallelFor(pool, numbands, numrows, [&](int t, int, int) {
+    int id = bandcomponents[t];
+    const vector<int>& roots = bandroots[t];
+    for( size_t j = 0; j < roots.size(); j++ ) {
+      if( parent[roots[j]] != roots[j] ) continue;
+      firstpixel[id] = roots[j];
+      parent[roots[j]] = -(id+1);
+      id++;
+    }
+  });
+  vector<vector<int> >& bandsizes = work.bandsizes;
+  GrowTo(bandsizes, numbands);
+  ParallelFor(pool, numbands, numrows, [&](int t, int ybegin, int yend) {
+    TraceSpan span("slic.relabel");
+    vector<int>& sizes = bandsizes[t];
+    sizes.assign(numcomponents, 0);
+    //backwards, so band roots are read before they are overwritten
+    for( int i = yend*rowsize - 1; i >= ybegin*rowsize; i-- ) {
+      int id;
+      if( parent[i] < 0 ) id = -parent[i] - 1;
+      else {
+        //a band root points at its final root, any other pixel at its band root
+        int r = parent[i];
+        if( parent[r] >= 0 ) r = parent[r];
+        id = -parent[r] - 1;
+        parent[i] = id;
+      }
+      sizes[id]++;
+    }
+  });
+  ParallelFor(pool, numbands, numcomponents, [&](int, int cbegin, int cend) {
+    for( int c = cbegin; c < cend; c++ ) {
+      for( int t = 0; t < numbands; t++ ) componentsize[c] += bandsizes[t][c];
+    }
+  });
+
+  //-------------------------------------------------------
+  // Decide the label of each component in the order the flood fill
+  // met them. A neighbour of the first pixel had been labelled by then
+  // iff it belongs to an earlier component.
+  //-------------------------------------------------------
+  vector<int>& componentlabel = work.componentlabel;
+  componentlabel.resize(numcomponents);
+  int label(0);
+  int adjlabel(0);//adjacent label
+  int nindices[10];
+  for( int c = 0; c < numcomponents; c++ ) {
+    const int numneighbours = neighbours(firstpixel[c], nindices);
+    for( int n = 0; n < numneighbours; n++ ) {
+      int nc = parent[nindices[n]] < 0 ? -parent[nindices[n]] - 1 : parent[nindices[n]];
+      if( nc < c ) adjlabel = componentlabel[nc];
+    }
+    //-------------------------------------------------------
+    // If segment size is less then a limit, assign an
+    // adjacent label found before, and decrement label count.
+    //-------------------------------------------------------
+    if( componentsize[c] <= SUPSZ >> 2 ) {
+      componentlabel[c] = adjlabel;
+    } else {
+      componentlabel[c] = label++;
+    }
+  }
+  numlabels = label;
+
+  ParallelFor(pool, numbands, numrows, [&](int, int ybegin, int yend) {
+    for( int i = ybegin*rowsize; i < yend*rowsize; i++ ) {
+      int c = nlabels[i] < 0 ? -nlabels[i] - 1 : nlabels[i];
+      nlabels[i] = componentlabel[c];
+    }
+  });
+}
+
+//===========================================================================
+/// EnforceLabelConnectivity
+///
+/// Components are 4-connected. Within a band, a pixel joins the set of its
+/// left neighbour and then that of the one above, unless the pixel between
+/// them already linked the two.
+//===========================================================================
+template<typename T>
+void SLIC<T>::EnforceLabelConnectivity(
   const int*                  labels,//input labels that need to be corrected to remove stray labels
   const int&                  width,
   const int&                  height,
   int*                        nlabels,//new labels
   int&                        numlabels,//the number of labels changes in the end if segments are removed
-  const int&                  K) //the number of superpixels desired by the user
+  const int&                  K, //the number of superpixels desired by the user
+  const int&                  numthreads)
 {
   //  const int dx8[8] = {-1, -1,  0,  1, 1, 1, 0, -1};
   //  const int dy8[8] = { 0, -1, -1, -1, 0, 1, 1,  1};
@@ -721,75 +2093,160 @@ void SLIC::EnforceLabelConnectivity(
 
   const int sz = width*height;
   const int SUPSZ = sz/K;
-  //nlabels.resize(sz, -1);
-  for( int i = 0; i < sz; i++ ) nlabels[i] = -1;
-  int label(0);
-  int* xvec = new int[sz];
-  int* yvec = new int[sz];
-  int oindex(0);
-  int adjlabel(0);//adjacent label
-  for( int j = 0; j < height; j++ ) {
-    for( int k = 0; k < width; k++ ) {
-      if( 0 > nlabels[oindex] ) {
-        nlabels[oindex] = label;
-        //--------------------
-        // Start a new segment
-        //--------------------
-        xvec[0] = k;
-        yvec[0] = j;
-        //-------------------------------------------------------
-        // Quickly find an adjacent label for use later if needed
-        //-------------------------------------------------------
-        {
-          for( int n = 0; n < 4; n++ ) {
-            int x = xvec[0] + dx4[n];
-            int y = yvec[0] + dy4[n];
-            if( (x >= 0 && x < width) && (y >= 0 && y < height) ) {
-              int nindex = y*width + x;
-              if(nlabels[nindex] >= 0) adjlabel = nlabels[nindex];
-            }
+  int* parent = nlabels;
+
+  RelabelComponents(labels, width, height, nlabels, numlabels, SUPSZ, numthreads,
+    [&](int ybegin, int yend) {
+      for( int y = ybegin; y < yend; y++ ) {
+        for( int x = 0; x < width; x++ ) {
+          int i = y*width + x;
+          int root = i;
+          if( x > 0 && labels[i-1] == labels[i] ) root = FindRoot(parent, i-1);
+          //left and up are joined already when the pixel between them matches
+          if( y > ybegin && labels[i-width] == labels[i] &&
+              (root == i || labels[i-width-1] != labels[i]) ) {
+            int up = FindRoot(parent, i-width);
+            if( root == i ) root = up;
+            else if( up < root ) { parent[root] = up; root = up; }
+            else if( root < up ) parent[up] = root;
           }
+          parent[i] = root;
         }
+      }
+    },
+    [&](const int& i, int* nindices) {
+      const int k = i%width;
+      const int j = i/width;
+      int count(0);
+      for( int n = 0; n < 4; n++ ) {
+        int x = k + dx4[n];
+        int y = j + dy4[n];
+        if( (x >= 0 && x < width) && (y >= 0 && y < height) ) nindices[count++] = y*width + x;
+      }
+      return count;
+    });
+}
 
-        int count(1);
-        for( int c = 0; c < count; c++ ) {
-          for( int n = 0; n < 4; n++ ) {
-            int x = xvec[c] + dx4[n];
-            int y = yvec[c] + dy4[n];
-
-            if( (x >= 0 && x < width) && (y >= 0 && y < height) ) {
-              int nindex = y*width + x;
-
-              if( 0 > nlabels[nindex] && labels[oindex] == labels[nindex] ) {
-                xvec[count] = x;
-                yvec[count] = y;
-                nlabels[nindex] = label;
-                count++;
-              }
+//===========================================================================
+/// EnforceSupervoxelLabelConnectivity
+///
+/// Components are connected through the ten neighbours of dx10/dy10/dz10:
+/// the eight around a voxel in its slice and the two above and below it.
+/// A band is a run of slices, and a voxel joins the sets of those of its
+/// neighbours that come before it in the band.
+//===========================================================================
+template<typename T>
+void SLIC<T>::EnforceSupervoxelLabelConnectivity(
+  const int*                  labels,
+  const int&                  width,
+  const int&                  height,
+  const int&                  depth,
+  int*                        nlabels,
+  int&                        numlabels,
+  const int&                  K)
+{
+  const int sz = width*height;
+  const int SUPSZ = sz*depth/K;
+  int* parent = nlabels;
+
+  RelabelComponents(labels, sz, depth, nlabels, numlabels, SUPSZ, m_numthreads,
+    [&](int zbegin, int zend) {
+      for( int z = zbegin; z < zend; z++ ) {
+        for( int y = 0; y < height; y++ ) {
+          for( int x = 0; x < width; x++ ) {
+            const int i = z*sz + y*width + x;
+            const int label = labels[i];
+            parent[i] = i;
+            if( x > 0 && labels[i-1] == label ) Unite(parent, i-1, i);
+            if( y > 0 ) {
+              const int j = i - width;
+              if( x > 0 && labels[j-1] == label ) Unite(parent, j-1, i);
+              if( labels[j] == label ) Unite(parent, j, i);
+              if( x+1 < width && labels[j+1] == label ) Unite(parent, j+1, i);
             }
-
+            if( z > zbegin && labels[i-sz] == label ) Unite(parent, i-sz, i);
           }
         }
-        //-------------------------------------------------------
-        // If segment size is less then a limit, assign an
-        // adjacent label found before, and decrement label count.
-        //-------------------------------------------------------
-        if(count <= SUPSZ >> 2) {
-          for( int c = 0; c < count; c++ ) {
-            int ind = yvec[c]*width+xvec[c];
-            nlabels[ind] = adjlabel;
-          }
-          label--;
+      }
+    },
+    [&](const int& i, int* nindices) {
+      const int d = i/sz;
+      const int h = (i%sz)/width;
+      const int w = i%width;
+      int count(0);
+      for( int n = 0; n < 10; n++ ) {
+        int x = w + dx10[n];
+        int y = h + dy10[n];
+        int z = d + dz10[n];
+        if( (x >= 0 && x < width) && (y >= 0 && y < height) && (z >= 0 && z < depth) ) {
+          nindices[count++] = z*sz + y*width + x;
         }
-        label++;
       }
-      oindex++;
-    }
+      return count;
+    });
+}
+
+//===========================================================================
+/// RestoreWarmStart
+///
+/// The seeds, maxlab and labels of the last run are only reused if it was
+/// the same size and was asked for the same step (or K), so that the seed
+/// count and the search windows are those a cold start would use.
+//===========================================================================
+template<typename T>
+bool SLIC<T>::RestoreWarmStart(
+  int*                        klabels,
+  const int&                  STEP,
+  const int&                  K) {
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  if( work.warmwidth != m_width || work.warmheight != m_height ) return false;
+  if( work.warmstep != STEP || work.warmk != K ) return false;
+
+  copy(work.warmlabels.begin(), work.warmlabels.begin() + m_width*m_height, klabels);
+  return true;
+}
+
+//===========================================================================
+/// SaveWarmStart
+//===========================================================================
+template<typename T>
+void SLIC<T>::SaveWarmStart(
+  const int*                  klabels,
+  const int&                  STEP,
+  const int&                  K) {
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  if( !m_warmstart ) {
+    //the seeds left in the workspace no longer go with the kept labels
+    work.warmwidth = work.warmheight = 0;
+    return;
   }
-  numlabels = label;
+  const int sz = m_width*m_height;
+  GrowTo(work.warmlabels, sz);
+  copy(klabels, klabels + sz, work.warmlabels.begin());
+  work.warmwidth = m_width;
+  work.warmheight = m_height;
+  work.warmstep = STEP;
+  work.warmk = K;
+}
 
-  if(xvec) delete [] xvec;
-  if(yvec) delete [] yvec;
+//===========================================================================
+/// GetSeeds_ForGivenStepSize
+//===========================================================================
+template<typename T>
+void SLIC<T>::GetSeeds_ForGivenStepSize(
+  const unsigned int*         ubuff,
+  const int                   width,
+  const int                   height,
+  const int&                  STEP,
+  vector<T>&                  kseedsl,
+  vector<T>&                  kseedsa,
+  vector<T>&                  kseedsb,
+  vector<T>&                  kseedsx,
+  vector<T>&                  kseedsy) {
+  m_width  = width;
+  m_height = height;
+  DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
+  GetLABXYSeeds_ForGivenStepSize(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, STEP, true);
 }
 
 //===========================================================================
@@ -797,44 +2254,59 @@ void SLIC::EnforceLabelConnectivity(
 ///
 /// There is option to save the labels if needed.
 //===========================================================================
-void SLIC::PerformSLICO_ForGivenStepSize(
+template<typename T>
+void SLIC<T>::PerformSLICO_ForGivenStepSize(
   const unsigned int*         ubuff,
   const int                   width,
   const int                   height,
   int*                        klabels,
   int&                        numlabels,
   const int&                  STEP,
-  const double&               m) {
+  const double&               m,
+  const int&                  numthreads) {
+  TraceSpan span("SLIC::PerformSLICO_ForGivenStepSize");
 
-  vector<double> kseedsl(0);
-  vector<double> kseedsa(0);
-  vector<double> kseedsb(0);
-  vector<double> kseedsx(0);
-  vector<double> kseedsy(0);
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  vector<T>& kseedsl = work.kseedsl;
+  vector<T>& kseedsa = work.kseedsa;
+  vector<T>& kseedsb = work.kseedsb;
+  vector<T>& kseedsx = work.kseedsx;
+  vector<T>& kseedsy = work.kseedsy;
 
   //--------------------------------------------------
   m_width  = width;
   m_height = height;
+  m_numthreads = max(1, numthreads);
   int sz = m_width*m_height;
   //klabels.resize( sz, -1 );
   //--------------------------------------------------
   //klabels = new int[sz];
-  for( int s = 0; s < sz; s++ ) klabels[s] = -1;
   //--------------------------------------------------
+  m_stagetimings.Reset();
+  StageClock::time_point stagestart = StageClock::now();
   DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
+  m_stagetimings.labconversion = EndStage("slic.lab", stagestart);
   //--------------------------------------------------
 
-  bool perturbseeds(true);
-  vector<double> edgemag(0);
-  if(perturbseeds) DetectLabEdges(m_lvec, m_avec, m_bvec, m_width, m_height, edgemag);
-  GetLABXYSeeds_ForGivenStepSize(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, STEP, perturbseeds, edgemag);
+  stagestart = StageClock::now();
+  const bool warmstart = m_warmstart && RestoreWarmStart(klabels, STEP, 0);
+  if(!warmstart) {
+    for( int s = 0; s < sz; s++ ) klabels[s] = -1;
 
-  PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,10);
+    bool perturbseeds(true);
+    GetLABXYSeeds_ForGivenStepSize(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, STEP, perturbseeds);
+  }
+  m_stagetimings.seeding = EndStage("slic.seeding", stagestart);
+
+  PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,m_maxiterations,warmstart);
   numlabels = kseedsl.size();
+  SaveWarmStart(klabels, STEP, 0);
 
-  int* nlabels = new int[sz];
-  EnforceLabelConnectivity(klabels, m_width, m_height, nlabels, numlabels, double(sz)/double(STEP*STEP)); {for(int i = 0; i < sz; i++ ) klabels[i] = nlabels[i];}
-  if(nlabels) delete [] nlabels;
+  stagestart = StageClock::now();
+  work.nlabels.resize(sz);
+  int* nlabels = &work.nlabels[0];
+  EnforceLabelConnectivity(klabels, m_width, m_height, nlabels, numlabels, double(sz)/double(STEP*STEP), m_numthreads); {for(int i = 0; i < sz; i++ ) klabels[i] = nlabels[i];}
+  m_stagetimings.connectivity = EndStage("slic.connectivity", stagestart);
 }
 
 //===========================================================================
@@ -842,34 +2314,41 @@ void SLIC::PerformSLICO_ForGivenStepSize(
 ///
 /// Zero parameter SLIC algorithm for a given number K of superpixels.
 //===========================================================================
-void SLIC::PerformSLICO_ForGivenK(
+template<typename T>
+void SLIC<T>::PerformSLICO_ForGivenK(
   const unsigned int*         ubuff,
   const int                   width,
   const int                   height,
   int*                        klabels,
   int&                        numlabels,
   const int&                  K,//required number of superpixels
-  const double&               m)//weight given to spatial distance
+  const double&               m,//weight given to spatial distance
+  const int&                  numthreads)
 {
+  TraceSpan span("SLIC::PerformSLICO_ForGivenK");
 
-  vector<double> kseedsl(0);
-  vector<double> kseedsa(0);
-  vector<double> kseedsb(0);
-  vector<double> kseedsx(0);
-  vector<double> kseedsy(0);
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  vector<T>& kseedsl = work.kseedsl;
+  vector<T>& kseedsa = work.kseedsa;
+  vector<T>& kseedsb = work.kseedsb;
+  vector<T>& kseedsx = work.kseedsx;
+  vector<T>& kseedsy = work.kseedsy;
 
   //--------------------------------------------------
   m_width  = width;
   m_height = height;
+  m_numthreads = max(1, numthreads);
   int sz = m_width*m_height;
   //--------------------------------------------------
   //if(0 == klabels) klabels = new int[sz];
-  for( int s = 0; s < sz; s++ ) klabels[s] = -1;
   //--------------------------------------------------
+  m_stagetimings.Reset();
+  StageClock::time_point stagestart = StageClock::now();
   if(1) {//LAB
     DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
   } else { //RGB
-    m_lvec = new double[sz]; m_avec = new double[sz]; m_bvec = new double[sz];
+    work.lvec.resize(sz); work.avec.resize(sz); work.bvec.resize(sz);
+    m_lvec = &work.lvec[0]; m_avec = &work.avec[0]; m_bvec = &work.bvec[0];
 
     for( int i = 0; i < sz; i++ ) {
       m_lvec[i] = ubuff[i] >> 16 & 0xff;
@@ -877,22 +2356,510 @@ void SLIC::PerformSLICO_ForGivenK(
       m_bvec[i] = ubuff[i]       & 0xff;
     }
   }
+  m_stagetimings.labconversion = EndStage("slic.lab", stagestart);
   //--------------------------------------------------
 
-  bool perturbseeds(true);
-  vector<double> edgemag(0);
-  if(perturbseeds) DetectLabEdges(m_lvec, m_avec, m_bvec, m_width, m_height, edgemag);
-  GetLABXYSeeds_ForGivenK(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, K, perturbseeds, edgemag);
-
+  stagestart = StageClock::now();
   int STEP = sqrt(double(sz)/double(K)) + 2.0;//adding a small value in the even the STEP size is too small.
+  const bool warmstart = m_warmstart && RestoreWarmStart(klabels, STEP, K);
+  if(!warmstart) {
+    for( int s = 0; s < sz; s++ ) klabels[s] = -1;
+
+    bool perturbseeds(true);
+    kseedsl.clear(); kseedsa.clear(); kseedsb.clear(); kseedsx.clear(); kseedsy.clear();
+    GetLABXYSeeds_ForGivenK(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, K, perturbseeds);
+  }
+  m_stagetimings.seeding = EndStage("slic.seeding", stagestart);
+
   //PerformSuperpixelSLIC(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, klabels, STEP, edgemag, m);
-  PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,10);
+  PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,klabels,STEP,m_maxiterations,warmstart);
   numlabels = kseedsl.size();
+  SaveWarmStart(klabels, STEP, K);
 
-  int* nlabels = new int[sz];
-  EnforceLabelConnectivity(klabels, m_width, m_height, nlabels, numlabels, K); {
+  stagestart = StageClock::now();
+  work.nlabels.resize(sz);
+  int* nlabels = &work.nlabels[0];
+  EnforceLabelConnectivity(klabels, m_width, m_height, nlabels, numlabels, K, m_numthreads); {
     for(int i = 0; i < sz; i++ )
       klabels[i] = nlabels[i];
   }
-  if(nlabels) delete [] nlabels;
+  m_stagetimings.connectivity = EndStage("slic.connectivity", stagestart);
 }
+
+//===========================================================================
+/// MatchSeamLabels
+///
+/// Two tiles' labels over the strip of pixels both of them segmented. A pair
+/// of labels is matched when each is the other's largest overlap and they
+/// share more than half of the pixels either of them covers in the strip.
+/// On return match[la] is the label matched to la, or -1.
+//===========================================================================
+static void MatchSeamLabels(
+  const vector<int>&          stripa,
+  const vector<int>&          stripb,
+  vector<pair<int,int> >&     pairs,
+  vector<int>&                match) {
+  pairs.resize(stripa.size());
+  int numa(0), numb(0);
+  for( size_t j = 0; j < stripa.size(); j++ ) {
+    pairs[j] = make_pair(stripa[j], stripb[j]);
+    numa = max(numa, stripa[j] + 1);
+    numb = max(numb, stripb[j] + 1);
+  }
+  sort(pairs.begin(), pairs.end());
+
+  vector<int> sizea(numa, 0), sizeb(numb, 0);
+  vector<int> besta(numa, 0), bestforb(numb, -1), bestb(numb, 0);
+  match.assign(numa, -1);
+  for( size_t j = 0; j < pairs.size(); ) {
+    const int la = pairs[j].first;
+    const int lb = pairs[j].second;
+    int count(0);
+    for( ; j < pairs.size() && pairs[j] == make_pair(la, lb); j++ ) count++;
+    sizea[la] += count;
+    sizeb[lb] += count;
+    if( count > besta[la] ) { besta[la] = count; match[la] = lb; }
+    if( count > bestb[lb] ) { bestb[lb] = count; bestforb[lb] = la; }
+  }
+  for( int la = 0; la < numa; la++ ) {
+    const int lb = match[la];
+    if( lb < 0 ) continue;
+    const int count = besta[la];
+    if( bestforb[lb] != la || 2*count <= sizea[la] + sizeb[lb] - count ) match[la] = -1;
+  }
+}
+
+//===========================================================================
+/// PerformSLICO_ForGivenStepSize_Tiled
+///
+/// Segments the image one tile at a time, in raster order. Each tile is run
+/// with a halo of at least 2*STEP pixels and only the labels of its core are
+/// kept, with one id per connected piece of a tile superpixel. Neighbouring
+/// tiles both segment a strip twice the halo wide around their seam; superpixels
+/// that match over that strip have their pieces on either side of the seam
+/// joined, and pieces too small to be superpixels are absorbed by a
+/// neighbour. Besides the caller's buffers, memory is a tile, the strip below
+/// the previous tile row and one union-find entry per piece.
+//===========================================================================
+template<typename T>
+void SLIC<T>::PerformSLICO_ForGivenStepSize_Tiled(
+  const unsigned int*         ubuff,
+  const int                   width,
+  const int                   height,
+  int*                        klabels,
+  int&                        numlabels,
+  const int&                  STEP,
+  const double&               m,
+  const int&                  tilesize,
+  const int&                  halosize,
+  const int&                  numthreads) {
+  TraceSpan span("SLIC::PerformSLICO_ForGivenStepSize_Tiled");
+  const int dx4[4] = {-1,  0,  1,  0};
+  const int dy4[4] = { 0, -1,  0,  1};
+
+  const int halo = max(2*STEP, halosize);
+  const int ts = max(1, tilesize/STEP)*STEP;//tile seeds stay on the STEP grid
+
+  vector<unsigned int> tilebuff;
+  vector<int> tilelabels;
+  vector<int> stack;
+  vector<int> parent;
+  vector<int> stripa, stripb, match;
+  vector<pair<int,int> > pairs;
+  //------------------------------------------------------------------------
+  // Labels the last tile gave the strip around its right seam, and those the
+  // row of tiles above gave the strip around their bottom seams.
+  //------------------------------------------------------------------------
+  vector<int> rightstrip(ts*2*halo);
+  vector<int> bottomstrip(width*2*halo);
+  int numitr(0);
+
+  for( int y0 = 0; y0 < height; y0 += ts ) {
+    const int y1 = min(height, y0 + ts);
+    const int hy0 = max(0, y0 - halo);
+    const int hy1 = min(height, y1 + halo);
+
+    for( int x0 = 0; x0 < width; x0 += ts ) {
+      const int x1 = min(width, x0 + ts);
+      const int hx0 = max(0, x0 - halo);
+      const int hx1 = min(width, x1 + halo);
+      const int tw = hx1 - hx0;
+      const int th = hy1 - hy0;
+
+      tilebuff.resize(tw*th);
+      tilelabels.resize(tw*th);
+      for( int y = hy0; y < hy1; y++ ) {
+        copy(ubuff + y*width + hx0, ubuff + y*width + hx1, tilebuff.begin() + (y - hy0)*tw);
+      }
+
+      {
+        SLIC<T> tileslic;
+        tileslic.m_workspace = m_workspace;
+        tileslic.m_fastlab = m_fastlab;
+        tileslic.m_maxiterations = m_maxiterations;
+        tileslic.m_labelchangethreshold = m_labelchangethreshold;
+        tileslic.m_displacementthreshold = m_displacementthreshold;
+        tileslic.m_activeset = m_activeset;
+        tileslic.m_activetolerance = m_activetolerance;
+        int tilenumlabels(0);
+        tileslic.PerformSLICO_ForGivenStepSize(&tilebuff[0], tw, th, &tilelabels[0], tilenumlabels, STEP, m, numthreads);
+        numitr = max(numitr, tileslic.m_numitr);
+      }
+      //tile label of image pixel (x, y)
+      auto local = [&](const int& x, const int& y) { return tilelabels[(y - hy0)*tw + (x - hx0)]; };
+
+      //-------------------------------------------------------
+      // Give every connected piece of a superpixel in the core its own id
+      //-------------------------------------------------------
+      for( int y = y0; y < y1; y++ ) {
+        for( int x = x0; x < x1; x++ ) klabels[y*width + x] = -1;
+      }
+      for( int y = y0; y < y1; y++ ) {
+        for( int x = x0; x < x1; x++ ) {
+          if( klabels[y*width + x] >= 0 ) continue;
+          const int id = parent.size();
+          const int label = local(x, y);
+          parent.push_back(id);
+          klabels[y*width + x] = id;
+          stack.assign(1, y*width + x);
+          while( !stack.empty() ) {
+            const int i = stack.back();
+            stack.pop_back();
+            for( int n = 0; n < 4; n++ ) {
+              int nx = i%width + dx4[n];
+              int ny = i/width + dy4[n];
+              if( nx < x0 || nx >= x1 || ny < y0 || ny >= y1 ) continue;
+              if( klabels[ny*width + nx] >= 0 || local(nx, ny) != label ) continue;
+              klabels[ny*width + nx] = id;
+              stack.push_back(ny*width + nx);
+            }
+          }
+        }
+      }
+
+      //-------------------------------------------------------
+      // Join the pieces on either side of the left and top seams
+      // where the superpixels they were cut from match.
+      //-------------------------------------------------------
+      const int sx0 = max(0, x0 - halo), sx1 = min(width, x0 + halo);
+      if( x0 > 0 ) {
+        stripa.clear();
+        stripb.clear();
+        for( int y = y0; y < y1; y++ ) {
+          for( int x = sx0; x < sx1; x++ ) {
+            stripa.push_back(rightstrip[(y - y0)*2*halo + (x - sx0)]);
+            stripb.push_back(local(x, y));
+          }
+        }
+        MatchSeamLabels(stripa, stripb, pairs, match);
+        for( int y = y0; y < y1; y++ ) {
+          if( match[rightstrip[(y - y0)*2*halo + (x0 - 1 - sx0)]] == local(x0, y) ) {
+            Unite(&parent[0], klabels[y*width + x0 - 1], klabels[y*width + x0]);
+          }
+        }
+      }
+      const int sy0 = max(0, y0 - halo), sy1 = min(height, y0 + halo);
+      if( y0 > 0 ) {
+        stripa.clear();
+        stripb.clear();
+        for( int y = sy0; y < sy1; y++ ) {
+          for( int x = x0; x < x1; x++ ) {
+            stripa.push_back(bottomstrip[(y - sy0)*width + x]);
+            stripb.push_back(local(x, y));
+          }
+        }
+        MatchSeamLabels(stripa, stripb, pairs, match);
+        for( int x = x0; x < x1; x++ ) {
+          if( match[bottomstrip[(y0 - 1 - sy0)*width + x]] == local(x, y0) ) {
+            Unite(&parent[0], klabels[(y0 - 1)*width + x], klabels[y0*width + x]);
+          }
+        }
+      }
+
+      //-------------------------------------------------------
+      // Keep this tile's side of the right and bottom seams
+      //-------------------------------------------------------
+      const int rx0 = max(0, x1 - halo), rx1 = min(width, x1 + halo);
+      for( int y = y0; y < y1 && x1 < width; y++ ) {
+        for( int x = rx0; x < rx1; x++ ) rightstrip[(y - y0)*2*halo + (x - rx0)] = local(x, y);
+      }
+      const int by0 = max(0, y1 - halo), by1 = min(height, y1 + halo);
+      for( int y = by0; y < by1 && y1 < height; y++ ) {
+        for( int x = x0; x < x1; x++ ) bottomstrip[(y - by0)*width + x] = local(x, y);
+      }
+    }
+  }
+
+  //--------------------------------------------------
+  // Pieces smaller than a quarter of a superpixel join the piece
+  // above or to the left of their first pixel, as in
+  // EnforceLabelConnectivity.
+  //--------------------------------------------------
+  const int sz = width*height;
+  vector<int> piecesize(parent.size(), 0);
+  for( int i = 0; i < sz; i++ ) piecesize[FindRoot(&parent[0], klabels[i])]++;
+  vector<char> visited(parent.size(), 0);
+  for( int i = 0; i < sz; i++ ) {
+    int root = FindRoot(&parent[0], klabels[i]);
+    if( visited[root] ) continue;
+    visited[root] = 1;
+    if( piecesize[root] > (STEP*STEP) >> 2 || i == 0 ) continue;
+    int adjacent = FindRoot(&parent[0], klabels[i%width > 0 ? i - 1 : i - width]);
+    Unite(&parent[0], root, adjacent);
+    piecesize[FindRoot(&parent[0], root)] = piecesize[root] + piecesize[adjacent];
+  }
+
+  //--------------------------------------------------
+  // Number the stitched superpixels in raster order
+  //--------------------------------------------------
+  vector<int> newlabels(parent.size(), -1);
+  numlabels = 0;
+  for( int i = 0; i < sz; i++ ) {
+    int root = FindRoot(&parent[0], klabels[i]);
+    if( newlabels[root] < 0 ) newlabels[root] = numlabels++;
+    klabels[i] = newlabels[root];
+  }
+  m_numitr = numitr;
+}
+
+//===========================================================================
+/// PerformSLICO_ForGivenStepSize_Pyramid
+///
+/// Level l is the LAB image 2x2 box filtered and decimated l times. Its pixel
+/// x covers full image pixels 2^l*x to 2^l*x + 2^l - 1, and its step is STEP
+/// divided by 2^l and rounded up, so that the windows still reach every
+/// pixel. Going one level finer, labels are replicated over 2x2 pixels and
+/// centroids map from x to 2x + 0.5. Levels whose step would fall below two
+/// pixels are dropped, as are any beyond kMaxPyramidLevels.
+//===========================================================================
+static const int kMaxPyramidLevels = 32;
+
+template<typename T>
+void SLIC<T>::PerformSLICO_ForGivenStepSize_Pyramid(
+  const unsigned int*         ubuff,
+  const int                   width,
+  const int                   height,
+  int*                        klabels,
+  int&                        numlabels,
+  const int&                  STEP,
+  const double&               m,
+  const int&                  numlevels,
+  const int&                  refineiterations,
+  const int&                  numthreads) {
+  TraceSpan span("SLIC::PerformSLICO_ForGivenStepSize_Pyramid");
+  typedef StageClock Clock;
+  Clock::time_point start = Clock::now();
+
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  vector<T>& kseedsl = work.kseedsl;
+  vector<T>& kseedsa = work.kseedsa;
+  vector<T>& kseedsb = work.kseedsb;
+  vector<T>& kseedsx = work.kseedsx;
+  vector<T>& kseedsy = work.kseedsy;
+
+  //--------------------------------------------------
+  m_width  = width;
+  m_height = height;
+  m_numthreads = max(1, numthreads);
+  const int sz = m_width*m_height;
+  int levels = max(1, min(numlevels, kMaxPyramidLevels));
+  while( levels > 1 && (STEP >> (levels - 1)) < 2 ) levels--;
+  m_leveltimings.assign(levels, 0);
+  m_stagetimings.Reset();
+  //--------------------------------------------------
+  DoRGBtoLABConversion(ubuff, m_lvec, m_avec, m_bvec);
+  m_stagetimings.labconversion = EndStage("slic.lab", start);
+  //--------------------------------------------------
+
+  //--------------------------------------------------
+  // Seeds are placed on the full image, so there are as many as
+  // PerformSLICO_ForGivenStepSize would use.
+  //--------------------------------------------------
+  Clock::time_point stagestart = Clock::now();
+  bool perturbseeds(true);
+  GetLABXYSeeds_ForGivenStepSize(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, STEP, perturbseeds);
+  const int numk = kseedsl.size();
+  m_stagetimings.seeding = EndStage("slic.seeding", stagestart);
+
+  //--------------------------------------------------
+  // Build the pyramid
+  //--------------------------------------------------
+  GrowTo(work.pyramidl, levels);
+  GrowTo(work.pyramida, levels);
+  GrowTo(work.pyramidb, levels);
+  GrowTo(work.pyramidlabels, levels);
+  T* levell[kMaxPyramidLevels] = { m_lvec };
+  T* levela[kMaxPyramidLevels] = { m_avec };
+  T* levelb[kMaxPyramidLevels] = { m_bvec };
+  int levelwidth[kMaxPyramidLevels] = { m_width };
+  int levelheight[kMaxPyramidLevels] = { m_height };
+  for( int l = 1; l < levels; l++ ) {
+    Clock::time_point levelstart = Clock::now();
+    const int w0 = levelwidth[l-1], h0 = levelheight[l-1];
+    const int w1 = (w0 + 1)/2, h1 = (h0 + 1)/2;
+    work.pyramidl[l].resize(w1*h1);
+    work.pyramida[l].resize(w1*h1);
+    work.pyramidb[l].resize(w1*h1);
+    levell[l] = &work.pyramidl[l][0];
+    levela[l] = &work.pyramida[l][0];
+    levelb[l] = &work.pyramidb[l][0];
+    levelwidth[l] = w1;
+    levelheight[l] = h1;
+
+    const T* srcs[3] = { levell[l-1], levela[l-1], levelb[l-1] };
+    T* dsts[3] = { levell[l], levela[l], levelb[l] };
+    ParallelFor(work.pool, m_numthreads, h1, [&](int, int ybegin, int yend) {
+      for( int c = 0; c < 3; c++ ) {
+        const T* src = srcs[c];
+        T* dst = dsts[c];
+        for( int y = ybegin; y < yend; y++ ) {
+          //the last row and column are repeated when the size is odd
+          const T* row0 = src + (2*y)*w0;
+          const T* row1 = src + min(2*y + 1, h0 - 1)*w0;
+          for( int x = 0; x < w1; x++ ) {
+            const int x0 = 2*x, x1 = min(2*x + 1, w0 - 1);
+            dst[y*w1 + x] = (row0[x0] + row0[x1] + row1[x0] + row1[x1])*T(0.25);
+          }
+        }
+      }
+    });
+    m_leveltimings[l] += EndStage("slic.downsample", levelstart);
+  }
+
+  //--------------------------------------------------
+  // The seeds start on the coarsest level with its colors
+  //--------------------------------------------------
+  const int coarsest = levels - 1;
+  const T scale = T(1 << coarsest);
+  for( int k = 0; k < numk; k++ ) {
+    kseedsx[k] = max(T(0), min(T(levelwidth[coarsest] - 1), (kseedsx[k] - (scale - 1)/2)/scale));
+    kseedsy[k] = max(T(0), min(T(levelheight[coarsest] - 1), (kseedsy[k] - (scale - 1)/2)/scale));
+    const int i = int(kseedsy[k] + T(0.5))*levelwidth[coarsest] + int(kseedsx[k] + T(0.5));
+    kseedsl[k] = levell[coarsest][i];
+    kseedsa[k] = levela[coarsest][i];
+    kseedsb[k] = levelb[coarsest][i];
+  }
+
+  //--------------------------------------------------
+  // Converge on the coarsest level, then refine down to the full image
+  //--------------------------------------------------
+  for( int l = coarsest; l >= 0; l-- ) {
+    Clock::time_point levelstart = Clock::now();
+    m_width = levelwidth[l];
+    m_height = levelheight[l];
+    m_lvec = levell[l];
+    m_avec = levela[l];
+    m_bvec = levelb[l];
+    int* labels = klabels;
+    if( l > 0 ) {
+      work.pyramidlabels[l].resize(m_width*m_height);
+      labels = &work.pyramidlabels[l][0];
+    }
+    const int levelstep = (STEP + (1 << l) - 1) >> l;
+
+    if( l == coarsest ) {
+      for( int i = 0; i < m_width*m_height; i++ ) labels[i] = -1;
+      PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,labels,levelstep,m_maxiterations);
+    } else {
+      const int* coarse = &work.pyramidlabels[l+1][0];
+      const int coarsewidth = levelwidth[l+1];
+      ParallelFor(work.pool, m_numthreads, m_height, [&](int, int ybegin, int yend) {
+        for( int y = ybegin; y < yend; y++ ) {
+          for( int x = 0; x < m_width; x++ ) labels[y*m_width + x] = coarse[(y/2)*coarsewidth + x/2];
+        }
+      });
+      for( int k = 0; k < numk; k++ ) {
+        kseedsx[k] = 2*kseedsx[k] + T(0.5);
+        kseedsy[k] = 2*kseedsy[k] + T(0.5);
+      }
+      PerformSuperpixelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,labels,levelstep,refineiterations,false,true);
+    }
+    if( l > 0 ) m_leveltimings[l] += MillisecondsSince(levelstart);
+  }
+  numlabels = numk;
+  SaveWarmStart(klabels, STEP, 0);
+
+  stagestart = Clock::now();
+  work.nlabels.resize(sz);
+  int* nlabels = &work.nlabels[0];
+  EnforceLabelConnectivity(klabels, m_width, m_height, nlabels, numlabels, double(sz)/double(STEP*STEP), m_numthreads); {for(int i = 0; i < sz; i++ ) klabels[i] = nlabels[i];}
+  m_stagetimings.connectivity = EndStage("slic.connectivity", stagestart);
+
+  //the full image is also charged for the conversion, seeding and connectivity
+  double total = MillisecondsSince(start);
+  for( int l = 1; l < levels; l++ ) total -= m_leveltimings[l];
+  m_leveltimings[0] = total;
+}
+
+//===========================================================================
+/// PerformSLICO_ForGivenStepSize_Supervoxels
+///
+/// The slices are converted into one contiguous LAB volume in the
+/// workspace, and the labels are worked on there too before being copied
+/// out to the caller's slices.
+//===========================================================================
+template<typename T>
+void SLIC<T>::PerformSLICO_ForGivenStepSize_Supervoxels(
+  const unsigned int**        ubuffvec,
+  const int                   width,
+  const int                   height,
+  const int                   depth,
+  int**                       klabels,
+  int&                        numlabels,
+  const int&                  STEP,
+  const double&               m,
+  const int&                  numthreads) {
+  TraceSpan span("SLIC::PerformSLICO_ForGivenStepSize_Supervoxels");
+
+  typename SLICWorkspace<T>::Buffers& work = *m_workspace->m_buffers;
+  vector<T>& kseedsl = work.kseedsl;
+  vector<T>& kseedsa = work.kseedsa;
+  vector<T>& kseedsb = work.kseedsb;
+  vector<T>& kseedsx = work.kseedsx;
+  vector<T>& kseedsy = work.kseedsy;
+  vector<T>& kseedsz = work.kseedsz;
+
+  //--------------------------------------------------
+  m_width  = width;
+  m_height = height;
+  m_depth  = depth;
+  m_numthreads = max(1, numthreads);
+  const int sz = m_width*m_height;
+  const int numvoxels = sz*m_depth;
+  //--------------------------------------------------
+  m_stagetimings.Reset();
+  StageClock::time_point stagestart = StageClock::now();
+  DoRGBtoLABConversion(ubuffvec, m_lvecvec, m_avecvec, m_bvecvec);
+  m_lvec = m_lvecvec[0];
+  m_avec = m_avecvec[0];
+  m_bvec = m_bvecvec[0];
+  m_stagetimings.labconversion = EndStage("slic.lab", stagestart);
+  //--------------------------------------------------
+
+  stagestart = StageClock::now();
+  GetLABXYZSeeds_ForGivenStepSize(kseedsl, kseedsa, kseedsb, kseedsx, kseedsy, kseedsz, STEP);
+  m_stagetimings.seeding = EndStage("slic.seeding", stagestart);
+
+  work.voxellabels.resize(numvoxels);
+  int* labels = &work.voxellabels[0];
+  for( int i = 0; i < numvoxels; i++ ) labels[i] = -1;
+  PerformSupervoxelSegmentation_VariableSandM(kseedsl,kseedsa,kseedsb,kseedsx,kseedsy,kseedsz,labels,STEP,m_maxiterations);
+  numlabels = kseedsl.size();
+  //nothing is left for a warm start
+  work.warmwidth = work.warmheight = 0;
+
+  stagestart = StageClock::now();
+  work.nlabels.resize(numvoxels);
+  int* nlabels = &work.nlabels[0];
+  EnforceSupervoxelLabelConnectivity(labels, m_width, m_height, m_depth, nlabels, numlabels, numlabels);
+  ParallelFor(work.pool, m_numthreads, m_depth, [&](int, int dbegin, int dend) {
+    for( int d = dbegin; d < dend; d++ ) copy(nlabels + d*sz, nlabels + (d+1)*sz, klabels[d]);
+  });
+  m_stagetimings.connectivity = EndStage("slic.connectivity", stagestart);
+}
+
+// Working precisions used by sc and the tests
+template class SLICWorkspace<float>;
+template class SLICWorkspace<double>;
+template class SLIC<float>;
+template class SLIC<double>;
@@ -31,6 +31,35 @@
 using namespace std;
 
 
+template<typename T> class SLIC;
+
+//============================================================================
+// Scratch memory for SLIC: the LAB planes, seeds, per thread buffers and the
+// worker threads. Owned by the caller and handed to any number of SLIC
+// objects in turn; buffers only grow, so once it has seen the largest image
+// of a batch, segmenting more images does not touch the heap.
+//============================================================================
+template<typename T = double>
+class SLICWorkspace
+{
+public:
+	SLICWorkspace();
+	virtual ~SLICWorkspace();
+
+private:
+	SLICWorkspace(const SLICWorkspace&);
+	SLICWorkspace& operator=(const SLICWorkspace&);
+
+	friend class SLIC<T>;
+	struct Buffers;
+	Buffers*								m_buffers;
+};
+
+//============================================================================
+// T is the working precision of the LAB planes, seeds and per pixel distance
+// buffers. Instantiated for float and double in SLIC.cpp.
+//============================================================================
+template<typename T = double>
 class SLIC  
 {
 public:
@@ -47,7 +76,8 @@ public:
 		int*						klabels,
 		int&						numlabels,
 		const int&					STEP,
-		const double&				m);
+		const double&				m,
+		const int&					numthreads = 1);//assignment step runs on this many threads
 
 	//============================================================================
 	// Superpixel segmentation for a given number of superpixels
@@ -59,10 +89,104 @@ public:
 		int*						klabels,
 		int&						numlabels,
 		const int&					K,
-		const double&				m);
+		const double&				m,
+		const int&					numthreads = 1);//assignment step runs on this many threads
+
+	//============================================================================
+	// The seeds PerformSLICO_ForGivenStepSize starts from, moved to the lowest
+	// color gradient around their grid position, without segmenting.
+	//============================================================================
+	void GetSeeds_ForGivenStepSize(
+		const unsigned int*			ubuff,//Each 32 bit unsigned int contains ARGB pixel values.
+		const int					width,
+		const int					height,
+		const int&					STEP,
+		vector<T>&					kseedsl,
+		vector<T>&					kseedsa,
+		vector<T>&					kseedsb,
+		vector<T>&					kseedsx,
+		vector<T>&					kseedsy);
+
+	//============================================================================
+	// Superpixel segmentation for a given step size, one tile of about
+	// tilesize*tilesize pixels at a time. Tiles are segmented with a halo of
+	// halosize pixels, at least 2*step, and their labels are stitched across
+	// the seams, so working memory is bounded by the tile size rather than the
+	// image size. A wider halo brings the seams closer to a whole image run.
+	//============================================================================
+	void PerformSLICO_ForGivenStepSize_Tiled(
+		const unsigned int*			ubuff,//Each 32 bit unsigned int contains ARGB pixel values.
+		const int					width,
+		const int					height,
+		int*						klabels,
+		int&						numlabels,
+		const int&					STEP,
+		const double&				m,
+		const int&					tilesize,
+		const int&					halosize = 0,
+		const int&					numthreads = 1);//each tile runs on this many threads
+
+	//============================================================================
+	// Superpixel segmentation for a given step size, coarse to fine. The seeds
+	// are those of the full image, and are iterated to convergence on the
+	// coarsest of numlevels 2x downsampled LAB images, then refined with
+	// refineiterations iterations at each finer level, the full image last.
+	// GetNumIterations() then counts those run on the full image.
+	//============================================================================
+	void PerformSLICO_ForGivenStepSize_Pyramid(
+		const unsigned int*			ubuff,//Each 32 bit unsigned int contains ARGB pixel values.
+		const int					width,
+		const int					height,
+		int*						klabels,
+		int&						numlabels,
+		const int&					STEP,
+		const double&				m,
+		const int&					numlevels,//including the full image
+		const int&					refineiterations = 2,
+		const int&					numthreads = 1);//assignment step runs on this many threads
+
+	//============================================================================
+	// Supervoxel segmentation for a given step size (supervoxel size ~=
+	// step*step*step) of a volume of depth width*height slices, such as the
+	// layers of a texture array or a volume texture. Labels are numbered
+	// across the volume, so a supervoxel keeps its label from slice to slice.
+	//============================================================================
+	void PerformSLICO_ForGivenStepSize_Supervoxels(
+		const unsigned int**		ubuffvec,//depth slices of ARGB pixels
+		const int					width,
+		const int					height,
+		const int					depth,
+		int**						klabels,//depth slices of labels
+		int&						numlabels,
+		const int&					STEP,
+		const double&				m,
+		const int&					numthreads = 1);//assignment and connectivity run on this many threads
+
+	//============================================================================
+	// Milliseconds the last pyramid segmentation spent on each level, building
+	// and iterating it, the full image first. The full image also accounts for
+	// the LAB conversion, seeding and connectivity.
+	//============================================================================
+	const vector<double>& GetLevelTimings() const { return m_leveltimings; }
+
+	//============================================================================
+	// Milliseconds the last PerformSLICO_ForGivenStepSize, _ForGivenK, _Pyramid
+	// or _Supervoxels call spent in each stage. There is one iteration entry
+	// per k-means iteration, over all levels of a pyramid.
+	//============================================================================
+	struct StageTimings {
+		StageTimings() : labconversion(0), seeding(0), connectivity(0) {}
+		void Reset() { labconversion = seeding = connectivity = 0; iterations.clear(); }//keeps the capacity
+		double						labconversion;
+		double						seeding;
+		vector<double>				iterations;
+		double						connectivity;
+	};
+	const StageTimings& GetStageTimings() const { return m_stagetimings; }
 
 	//============================================================================
-	// Save superpixel labels in a text file in raster scan order
+	// Save superpixel labels in raster scan order to path + <name>.dat, as
+	// raw ints. WriteLabelMap in LabelMap.h writes a much smaller file.
 	//============================================================================
 	void SaveSuperpixelLabels(
 		const int*					labels,
@@ -88,6 +212,93 @@ public:
 		const int&					width,
 		const int&					height);
 
+	//============================================================================
+	// Choose between the table driven (SIMD where available) sRGB to CIELAB
+	// conversion and the pow() based reference one. The fast path is the default.
+	//============================================================================
+	void SetFastLABConversion(const bool& fast) { m_fastlab = fast; }
+
+	//============================================================================
+	// sRGB to CIELAB conversion of sz ARGB pixels into caller owned planes.
+	//============================================================================
+	void ConvertRGBtoLAB(
+		const unsigned int*			ubuff,
+		const int&					sz,
+		T*							lvec,
+		T*							avec,
+		T*							bvec);
+
+	//============================================================================
+	// Use a caller owned workspace for all scratch memory; NULL goes back to
+	// the one owned by this object. The workspace must outlive its use here.
+	//============================================================================
+	void SetWorkspace(SLICWorkspace<T>* workspace) { m_workspace = workspace ? workspace : &m_ownworkspace; }
+
+	//============================================================================
+	// Upper bound on the k-means iterations (10 by default).
+	//============================================================================
+	void SetMaxIterations(const int& maxiterations) { m_maxiterations = maxiterations; }
+
+	//============================================================================
+	// Stop iterating once the fraction of pixels that changed label, or the
+	// largest centroid displacement in pixels, falls below its threshold.
+	// A threshold of zero disables that test; both are off by default.
+	//============================================================================
+	void SetConvergenceThresholds(
+		const double&				labelchange,
+		const double&				displacement)
+	{
+		m_labelchangethreshold = labelchange;
+		m_displacementthreshold = displacement;
+	}
+
+	//============================================================================
+	// Number of k-means iterations the last segmentation actually ran.
+	//============================================================================
+	int GetNumIterations() const { return m_numitr; }
+
+	//============================================================================
+	// After the first full iteration, only rescan the windows of clusters whose
+	// seed moved by at least 'tolerance' pixels in the previous one, and of
+	// their neighbours. Stops once no seed moves. The colour maxima then come
+	// from the winning seed of each pixel. Off by default.
+	//============================================================================
+	void SetActiveSetIterations(
+		const bool&					activeset,
+		const double&				tolerance = 0.5)
+	{
+		m_activeset = activeset;
+		m_activetolerance = tolerance;
+	}
+
+	//============================================================================
+	// Start each segmentation from the centroids and labels the previous one on
+	// the same workspace left, when it had the same size and step (or K), as
+	// for consecutive frames of an animation. Seeding is skipped, and iterating
+	// stops once fewer than a 'labelchange' fraction of the pixels change label.
+	// Off by default.
+	//============================================================================
+	void SetWarmStart(
+		const bool&					warmstart,
+		const double&				labelchange = 0.01)
+	{
+		m_warmstart = warmstart;
+		m_warmlabelchange = labelchange;
+	}
+
+	//============================================================================
+	// Post-processing of SLIC segmentation, to avoid stray labels. The entry
+	// points run it on their own labels; it works on labels from anywhere.
+	//============================================================================
+	void EnforceLabelConnectivity(
+		const int*					labels,
+		const int&					width,
+		const int&					height,
+		int*						nlabels,//input labels that need to be corrected to remove stray labels
+		int&						numlabels,//the number of labels changes in the end if segments are removed
+		const int&					K, //the number of superpixels desired by the user
+		const int&					numthreads);
+
 private:
 
 	//============================================================================
@@ -95,11 +306,46 @@ private:
 	// SLICO (SLIC Zero) varies only M dynamicaly, not S.
 	//============================================================================
 	void PerformSuperpixelSegmentation_VariableSandM(
-		vector<double>&				kseedsl,
-		vector<double>&				kseedsa,
-		vector<double>&				kseedsb,
-		vector<double>&				kseedsx,
-		vector<double>&				kseedsy,
+		vector<T>&					kseedsl,
+		vector<T>&					kseedsa,
+		vector<T>&					kseedsb,
+		vector<T>&					kseedsx,
+		vector<T>&					kseedsy,
+		int*						klabels,
+		const int&					STEP,
+		const int&					NUMITR,
+		const bool&					warmstart = false,//klabels, the seeds and maxlab are carried over
+		const bool&					keepmaxlab = false);//maxlab is carried over, as between pyramid levels
+
+	//============================================================================
+	// Put back the labels the previous segmentation on the workspace kept for
+	// a warm start. Returns false if that run was not like this one.
+	//============================================================================
+	bool RestoreWarmStart(
+		int*						klabels,
+		const int&					STEP,
+		const int&					K);
+
+	//============================================================================
+	// Keep the labels of this segmentation for the next one, if warm starts
+	// are on, and forget the old ones otherwise.
+	//============================================================================
+	void SaveWarmStart(
+		const int*					klabels,
+		const int&					STEP,
+		const int&					K);
+
+	//============================================================================
+	// Magic SLIC for supervoxels, over the volume held in m_lvec, m_avec and
+	// m_bvec one slice after the other.
+	//============================================================================
+	void PerformSupervoxelSegmentation_VariableSandM(
+		vector<T>&					kseedsl,
+		vector<T>&					kseedsa,
+		vector<T>&					kseedsb,
+		vector<T>&					kseedsx,
+		vector<T>&					kseedsy,
+		vector<T>&					kseedsz,
 		int*						klabels,
 		const int&					STEP,
 		const int&					NUMITR);
@@ -108,49 +354,54 @@ private:
 	// Pick seeds for superpixels when step size of superpixels is given.
 	//============================================================================
 	void GetLABXYSeeds_ForGivenStepSize(
-		vector<double>&				kseedsl,
-		vector<double>&				kseedsa,
-		vector<double>&				kseedsb,
-		vector<double>&				kseedsx,
-		vector<double>&				kseedsy,
+		vector<T>&					kseedsl,
+		vector<T>&					kseedsa,
+		vector<T>&					kseedsb,
+		vector<T>&					kseedsx,
+		vector<T>&					kseedsy,
 		const int&					STEP,
-		const bool&					perturbseeds,
-		const vector<double>&		edgemag);
+		const bool&					perturbseeds);
 
 	//============================================================================
 	// Pick seeds for superpixels when number of superpixels is input.
 	//============================================================================
 	void GetLABXYSeeds_ForGivenK(
-		vector<double>&				kseedsl,
-		vector<double>&				kseedsa,
-		vector<double>&				kseedsb,
-		vector<double>&				kseedsx,
-		vector<double>&				kseedsy,
+		vector<T>&					kseedsl,
+		vector<T>&					kseedsa,
+		vector<T>&					kseedsb,
+		vector<T>&					kseedsx,
+		vector<T>&					kseedsy,
 		const int&					STEP,
-		const bool&					perturbseeds,
-		const vector<double>&		edges);
+		const bool&					perturbseeds);
+
+	//============================================================================
+	// Pick seeds for supervoxels on a grid of the given step size.
+	//============================================================================
+	void GetLABXYZSeeds_ForGivenStepSize(
+		vector<T>&					kseedsl,
+		vector<T>&					kseedsa,
+		vector<T>&					kseedsb,
+		vector<T>&					kseedsx,
+		vector<T>&					kseedsy,
+		vector<T>&					kseedsz,
+		const int&					STEP);
 
 	//============================================================================
 	// Move the seeds to low gradient positions to avoid putting seeds at region boundaries.
 	//============================================================================
 	void PerturbSeeds(
-		vector<double>&				kseedsl,
-		vector<double>&				kseedsa,
-		vector<double>&				kseedsb,
-		vector<double>&				kseedsx,
-		vector<double>&				kseedsy,
-		const vector<double>&		edges);
+		vector<T>&					kseedsl,
+		vector<T>&					kseedsa,
+		vector<T>&					kseedsb,
+		vector<T>&					kseedsx,
+		vector<T>&					kseedsy);
 
 	//============================================================================
-	// Detect color edges, to help PerturbSeeds()
+	// Color gradient at one pixel of the image, to help PerturbSeeds()
 	//============================================================================
-	void DetectLabEdges(
-		const double*				lvec,
-		const double*				avec,
-		const double*				bvec,
-		const int&					width,
-		const int&					height,
-		vector<double>&				edges);
+	T DetectLabEdge(
+		const int&					x,
+		const int&					y);
 
 	//============================================================================
 	// xRGB to XYZ conversion; helper for RGB2LAB()
@@ -174,48 +425,92 @@ private:
 		double&						aval,
 		double&						bval);
 
+	//============================================================================
+	// sRGB to CIELAB conversion using the 8-bit linearization table and a fast
+	// cube root. Vectorized with SSE4.1/AVX2 when built with them.
+	//============================================================================
+	void RGB2LAB_Fast(
+		const unsigned int*			ubuff,
+		const int&					sz,
+		T*							lvec,
+		T*							avec,
+		T*							bvec);
+
 	//============================================================================
 	// sRGB to CIELAB conversion for 2-D images
 	//============================================================================
 	void DoRGBtoLABConversion(
 		const unsigned int*&		ubuff,
-		double*&					lvec,
-		double*&					avec,
-		double*&					bvec);
+		T*&							lvec,
+		T*&							avec,
+		T*&							bvec);
 
 	//============================================================================
 	// sRGB to CIELAB conversion for 3-D volumes
 	//============================================================================
 	void DoRGBtoLABConversion(
 		const unsigned int**&		ubuff,
-		double**&					lvec,
-		double**&					avec,
-		double**&					bvec);
+		T**&						lvec,
+		T**&						avec,
+		T**&						bvec);
 
 	//============================================================================
-	// Post-processing of SLIC segmentation, to avoid stray labels.
+	// Post-processing of supervoxel segmentation, to avoid stray labels.
 	//============================================================================
-	void EnforceLabelConnectivity(
-		const int*					labels,
+	void EnforceSupervoxelLabelConnectivity(
+		const int*					labels,//depth slices one after the other
 		const int&					width,
 		const int&					height,
-		int*						nlabels,//input labels that need to be corrected to remove stray labels
-		int&						numlabels,//the number of labels changes in the end if segments are removed
-		const int&					K); //the number of superpixels desired by the user
+		const int&					depth,
+		int*						nlabels,
+		int&						numlabels,
+		const int&					K); //the number of supervoxels desired by the user
+
+	//============================================================================
+	// Connected components of labels, numbered in raster order with the ones
+	// smaller than a quarter of SUPSZ given to a neighbour. Shared by the
+	// superpixel and supervoxel connectivity passes.
+	//============================================================================
+	template<typename UniteRows, typename Neighbours>
+	void RelabelComponents(
+		const int*					labels,
+		const int&					rowsize,//pixels in an image row or a volume slice
+		const int&					numrows,
+		int*						nlabels,
+		int&						numlabels,
+		const int&					SUPSZ,
+		const int&					numthreads,//bands of rows to find components in at once
+		const UniteRows&			uniterows,//uniterows(begin, end) builds the sets of those rows in nlabels
+		const Neighbours&			neighbours);//neighbours(i, nindices) lists the neighbours of i, returns how many
 
 
 private:
 	int										m_width;
 	int										m_height;
 	int										m_depth;
+	bool									m_fastlab;
+	int										m_numthreads;
+	int										m_maxiterations;
+	double									m_labelchangethreshold;
+	double									m_displacementthreshold;
+	int										m_numitr;
+	bool									m_activeset;
+	double									m_activetolerance;
+	bool									m_warmstart;
+	double									m_warmlabelchange;
+	vector<double>							m_leveltimings;
+	StageTimings							m_stagetimings;
+
+	SLICWorkspace<T>						m_ownworkspace;
+	SLICWorkspace<T>*						m_workspace;
 
-	double*									m_lvec;
-	double*									m_avec;
-	double*									m_bvec;
+	T*										m_lvec;//these point into the workspace
+	T*										m_avec;
+	T*										m_bvec;
 
-	double**								m_lvecvec;
-	double**								m_avecvec;
-	double**								m_bvecvec;
+	T**										m_lvecvec;//slices of the workspace planes
+	T**										m_avecvec;
+	T**										m_bvecvec;
 };
 
 #endif // !defined(_SLIC_H_INCLUDED_)
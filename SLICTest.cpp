@@ -0,0 +1,1131 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "SLIC.h"
+#include "Trace.h"
+#include "TexCompTypes.h"
+#include "StopWatch.h"
+
+// Every heap allocation in the test goes through here, so that the
+// workspace test can check that segmenting does not allocate.
+static std::atomic<uint32> gNumAllocations(0);
+
+void *operator new(std::size_t size) {
+  gNumAllocations++;
+  void *p = malloc(size > 0 ? size : 1);
+  if(!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+// GCC flags the free() below once it inlines this into library code,
+// although it matches the malloc() in operator new above.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept {
+  free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+// Smooth gradients with a few hard edged shapes and a little noise, so that
+// segmentation has both flat and textured areas to work with. Increasing
+// 'shift' slides the shapes and the texture along, as in an animation.
+static void GenerateImage(const int w, const int h, std::vector<unsigned int> &img,
+                          const int shift = 0) {
+  img.resize(w * h);
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      int r = (x * 255) / w;
+      int g = (y * 255) / h;
+      int b = static_cast<int>(128.0 + 100.0 * sin(0.05 * (x - shift)) * cos(0.03 * y));
+
+      int cx = (x + 970 - shift) % 97 - 48, cy = (y + 890 - shift / 2) % 89 - 44;
+      if(cx * cx + cy * cy < 900) {
+        r = 255 - r;
+        b = 40;
+      }
+
+      r = std::min(255, std::max(0, r + (rand() % 9) - 4));
+      g = std::min(255, std::max(0, g + (rand() % 9) - 4));
+      b = std::min(255, std::max(0, b + (rand() % 9) - 4));
+      img[y * w + x] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+  }
+}
+
+// Large flat patches with a handful of shapes, the case where most clusters
+// settle after a couple of iterations.
+static void GenerateFlatImage(const int w, const int h, std::vector<unsigned int> &img) {
+  img.resize(w * h);
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      int r = 60 + 40 * ((x / 256 + y / 256) % 3);
+      int g = 90;
+      int b = 200 - 50 * ((x / 256) % 2);
+
+      int cx = x % 331 - 165, cy = y % 317 - 158;
+      if(cx * cx + cy * cy < 2500) {
+        r = 230;
+        g = 40 + (x % 64);
+      }
+
+      g = std::min(255, std::max(0, g + (rand() % 3) - 1));
+      img[y * w + x] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+  }
+}
+
+// Fraction of horizontally and vertically adjacent pixel pairs on which both
+// segmentations agree whether the pair lies in the same segment. Unlike a
+// direct comparison this does not depend on how the segments are numbered.
+static double LabelAgreement(const int w, const std::vector<int> &a, const std::vector<int> &b) {
+  const int h = static_cast<int>(a.size()) / w;
+  uint32 same = 0, total = 0;
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      const int i = y * w + x;
+      if(x + 1 < w) {
+        same += ((a[i] == a[i + 1]) == (b[i] == b[i + 1])) ? 1 : 0;
+        total++;
+      }
+      if(y + 1 < h) {
+        same += ((a[i] == a[i + w]) == (b[i] == b[i + w])) ? 1 : 0;
+        total++;
+      }
+    }
+  }
+  return static_cast<double>(same) / static_cast<double>(total);
+}
+
+// Mean squared distance in RGB of each pixel from the mean color of its
+// segment; lower means the segments follow the image more closely.
+static double SegmentColorError(const std::vector<unsigned int> &img, const std::vector<int> &labels) {
+  const int numLabels = *std::max_element(labels.begin(), labels.end()) + 1;
+  std::vector<double> sum(numLabels * 3, 0), sumSq(numLabels, 0);
+  std::vector<int> count(numLabels, 0);
+  for(size_t i = 0; i < img.size(); i++) {
+    const int k = labels[i];
+    for(int c = 0; c < 3; c++) {
+      const double v = (img[i] >> (16 - 8 * c)) & 0xFF;
+      sum[k * 3 + c] += v;
+      sumSq[k] += v * v;
+    }
+    count[k]++;
+  }
+  double error = 0;
+  for(int k = 0; k < numLabels; k++) {
+    if(count[k] == 0) {
+      continue;
+    }
+    double mean = 0;
+    for(int c = 0; c < 3; c++) {
+      mean += sum[k * 3 + c] * sum[k * 3 + c];
+    }
+    error += sumSq[k] - mean / count[k];
+  }
+  return error / static_cast<double>(img.size());
+}
+
+// Number of 4-connected pieces the labels split the image into.
+static int CountComponents(const int w, const std::vector<int> &labels) {
+  const int h = static_cast<int>(labels.size()) / w;
+  std::vector<char> seen(labels.size(), 0);
+  std::vector<int> stack;
+  int components = 0;
+  for(int start = 0; start < w * h; start++) {
+    if(seen[start]) {
+      continue;
+    }
+    components++;
+    seen[start] = 1;
+    stack.assign(1, start);
+    while(!stack.empty()) {
+      const int i = stack.back();
+      stack.pop_back();
+      const int x = i % w, y = i / w;
+      const int neighbors[4] = { x > 0 ? i - 1 : -1, x + 1 < w ? i + 1 : -1,
+                                 y > 0 ? i - w : -1, y + 1 < h ? i + w : -1 };
+      for(int n = 0; n < 4; n++) {
+        if(neighbors[n] >= 0 && !seen[neighbors[n]] && labels[neighbors[n]] == labels[i]) {
+          seen[neighbors[n]] = 1;
+          stack.push_back(neighbors[n]);
+        }
+      }
+    }
+  }
+  return components;
+}
+
+static bool TestLABConversion() {
+  static const uint32 kNumColors = 1 << 24;
+  static const uint32 kChunk = 1 << 16;
+
+  std::vector<unsigned int> colors(kChunk);
+  std::vector<double> l0(kChunk), a0(kChunk), b0(kChunk);
+  std::vector<double> l1(kChunk), a1(kChunk), b1(kChunk);
+
+  SLIC<double> slic;
+  StopWatch stopwatch;
+  double referenceTime = 0.0, fastTime = 0.0;
+  double maxErr[3] = { 0.0, 0.0, 0.0 };
+  for(uint32 c = 0; c < kNumColors; c += kChunk) {
+    for(uint32 i = 0; i < kChunk; i++) {
+      colors[i] = 0xFF000000 | (c + i);
+    }
+
+    slic.SetFastLABConversion(false);
+    stopwatch.Reset();
+    stopwatch.Start();
+    slic.ConvertRGBtoLAB(&colors[0], kChunk, &l0[0], &a0[0], &b0[0]);
+    stopwatch.Stop();
+    referenceTime += stopwatch.TimeInMilliseconds();
+
+    slic.SetFastLABConversion(true);
+    stopwatch.Reset();
+    stopwatch.Start();
+    slic.ConvertRGBtoLAB(&colors[0], kChunk, &l1[0], &a1[0], &b1[0]);
+    stopwatch.Stop();
+    fastTime += stopwatch.TimeInMilliseconds();
+
+    for(uint32 i = 0; i < kChunk; i++) {
+      maxErr[0] = std::max(maxErr[0], fabs(l0[i] - l1[i]));
+      maxErr[1] = std::max(maxErr[1], fabs(a0[i] - a1[i]));
+      maxErr[2] = std::max(maxErr[2], fabs(b0[i] - b1[i]));
+    }
+  }
+
+  std::cout << "LAB conversion of all 2^24 colors" << std::endl;
+  std::cout << "Reference: " << referenceTime << " ms" << std::endl;
+  std::cout << "Fast: " << fastTime << " ms" << std::endl;
+  std::cout << "Max error (L, a, b): " << maxErr[0] << ", " << maxErr[1] << ", "
+            << maxErr[2] << std::endl << std::endl;
+
+  return maxErr[0] < 1e-2 && maxErr[1] < 1e-2 && maxErr[2] < 1e-2;
+}
+
+static bool TestLABLabelDrift() {
+  const int w = 512, h = 512, step = 5;
+  std::vector<unsigned int> img;
+  GenerateImage(w, h, img);
+
+  std::vector<int> reference(w * h), fast(w * h);
+  int nReference, nFast;
+
+  SLIC<double> slicReference;
+  slicReference.SetFastLABConversion(false);
+  slicReference.PerformSLICO_ForGivenStepSize(&img[0], w, h, &reference[0], nReference, step, 1.0);
+
+  SLIC<double> slicFast;
+  slicFast.PerformSLICO_ForGivenStepSize(&img[0], w, h, &fast[0], nFast, step, 1.0);
+
+  double agreement = LabelAgreement(w, reference, fast);
+  std::cout << "Labels (reference, fast): " << nReference << ", " << nFast << std::endl;
+  std::cout << "Label agreement: " << (100.0 * agreement) << "%" << std::endl << std::endl;
+
+  return agreement > 0.999;
+}
+
+template<typename T>
+static double TimeSegmentation(const std::vector<unsigned int> &img, const int w, const int h,
+                               const int step, std::vector<int> &labels, int &nLabels) {
+  SLIC<T> slic;
+  StopWatch stopwatch;
+  stopwatch.Start();
+  slic.PerformSLICO_ForGivenStepSize(&img[0], w, h, &labels[0], nLabels, step, 1.0);
+  stopwatch.Stop();
+  return stopwatch.TimeInMilliseconds();
+}
+
+static bool TestPrecision() {
+  const int w = 1024, h = 1024, step = 5;
+  std::vector<unsigned int> img;
+  GenerateImage(w, h, img);
+
+  std::vector<int> labelsDouble(w * h), labelsFloat(w * h);
+  int nDouble, nFloat;
+  double timeDouble = TimeSegmentation<double>(img, w, h, step, labelsDouble, nDouble);
+  double timeFloat = TimeSegmentation<float>(img, w, h, step, labelsFloat, nFloat);
+
+  double agreement = LabelAgreement(w, labelsDouble, labelsFloat);
+  std::cout << "SLIC<double>: " << timeDouble << " ms, " << nDouble << " labels" << std::endl;
+  std::cout << "SLIC<float>: " << timeFloat << " ms, " << nFloat << " labels" << std::endl;
+  std::cout << "Label agreement: " << (100.0 * agreement) << "%" << std::endl << std::endl;
+
+  return agreement > 0.99;
+}
+
+static bool TestThreadedAssignment() {
+  const int w = 1024, h = 768, step = 6;
+  std::vector<unsigned int> img;
+  GenerateImage(w, h, img);
+
+  bool identical = true;
+  std::vector<int> serial(w * h), threaded(w * h);
+  for(int numThreads = 2; numThreads <= 8; numThreads *= 2) {
+    int nSerial, nThreaded;
+
+    SLIC<float> slicSerial, slicThreaded;
+    slicSerial.PerformSLICO_ForGivenStepSize(&img[0], w, h, &serial[0], nSerial, step, 1.0);
+    slicThreaded.PerformSLICO_ForGivenStepSize(&img[0], w, h, &threaded[0], nThreaded, step, 1.0, numThreads);
+    identical = identical && nSerial == nThreaded && serial == threaded;
+
+    slicSerial.PerformSLICO_ForGivenK(&img[0], w, h, &serial[0], nSerial, 2000, 1.0);
+    slicThreaded.PerformSLICO_ForGivenK(&img[0], w, h, &threaded[0], nThreaded, 2000, 1.0, numThreads);
+    identical = identical && nSerial == nThreaded && serial == threaded;
+  }
+
+  std::cout << "Threaded assignment matches serial: " << (identical ? "yes" : "no")
+            << std::endl << std::endl;
+  return identical;
+}
+
+static bool TestConvergence() {
+  const int w = 1024, h = 1024, step = 8;
+  std::vector<unsigned int> img;
+  GenerateImage(w, h, img);
+
+  std::vector<int> full(w * h), early(w * h);
+  int nFull, nEarly;
+  StopWatch stopwatch;
+
+  SLIC<float> slicFull;
+  stopwatch.Start();
+  slicFull.PerformSLICO_ForGivenStepSize(&img[0], w, h, &full[0], nFull, step, 1.0);
+  stopwatch.Stop();
+  double timeFull = stopwatch.TimeInMilliseconds();
+
+  SLIC<float> slicEarly;
+  slicEarly.SetConvergenceThresholds(0.01, 0.25);
+  stopwatch.Reset();
+  stopwatch.Start();
+  slicEarly.PerformSLICO_ForGivenStepSize(&img[0], w, h, &early[0], nEarly, step, 1.0);
+  stopwatch.Stop();
+  double timeEarly = stopwatch.TimeInMilliseconds();
+
+  double agreement = LabelAgreement(w, full, early);
+  std::cout << "Fixed iterations: " << slicFull.GetNumIterations() << " in "
+            << timeFull << " ms" << std::endl;
+  std::cout << "Convergence: " << slicEarly.GetNumIterations() << " in "
+            << timeEarly << " ms" << std::endl;
+  std::cout << "Label agreement: " << (100.0 * agreement) << "%" << std::endl << std::endl;
+
+  return slicFull.GetNumIterations() == 10 && slicEarly.GetNumIterations() < 10 && agreement > 0.9;
+}
+
+static bool TestActiveSet() {
+  const int w = 1536, h = 1536, step = 8;
+  std::vector<unsigned int> img;
+  GenerateFlatImage(w, h, img);
+
+  std::vector<int> full(w * h), active(w * h), threaded(w * h);
+  int nFull, nActive, nThreaded;
+  StopWatch stopwatch;
+
+  SLIC<float> slicFull;
+  stopwatch.Start();
+  slicFull.PerformSLICO_ForGivenStepSize(&img[0], w, h, &full[0], nFull, step, 1.0);
+  stopwatch.Stop();
+  double timeFull = stopwatch.TimeInMilliseconds();
+
+  SLIC<float> slicActive;
+  slicActive.SetMaxIterations(20);
+  slicActive.SetActiveSetIterations(true);
+  stopwatch.Reset();
+  stopwatch.Start();
+  slicActive.PerformSLICO_ForGivenStepSize(&img[0], w, h, &active[0], nActive, step, 1.0);
+  stopwatch.Stop();
+  double timeActive = stopwatch.TimeInMilliseconds();
+
+  SLIC<float> slicThreaded;
+  slicThreaded.SetMaxIterations(20);
+  slicThreaded.SetActiveSetIterations(true);
+  slicThreaded.PerformSLICO_ForGivenStepSize(&img[0], w, h, &threaded[0], nThreaded, step, 1.0, 4);
+  bool identical = nActive == nThreaded && active == threaded;
+
+  double agreement = LabelAgreement(w, full, active);
+  std::cout << "Full iterations: " << slicFull.GetNumIterations() << " in "
+            << timeFull << " ms" << std::endl;
+  std::cout << "Active set: " << slicActive.GetNumIterations() << " in "
+            << timeActive << " ms" << std::endl;
+  std::cout << "Label agreement: " << (100.0 * agreement) << "%" << std::endl;
+  std::cout << "Threaded active set matches serial: " << (identical ? "yes" : "no")
+            << std::endl << std::endl;
+
+  return identical && agreement > 0.9;
+}
+
+// Like GenerateImage, but with its own noise generator so that the pixels,
+// and with them the labels, are the same on every platform.
+static void GenerateReferenceImage(const int w, const int h, std::vector<unsigned int> &img) {
+  img.resize(w * h);
+  uint32 seed = 12345;
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      seed = seed * 1664525 + 1013904223;
+      const int n = static_cast<int>((seed >> 24) % 9) - 4;
+
+      int r = (x * 255) / w;
+      int g = (y * 255) / h;
+      int b = ((x / 23 + y / 17) % 4) * 60;
+
+      int cx = x % 61 - 30, cy = y % 53 - 26;
+      if(cx * cx + cy * cy < 300) {
+        r = 255 - r;
+        b = 40;
+      }
+
+      r = std::min(255, std::max(0, r + n));
+      g = std::min(255, std::max(0, g - n));
+      b = std::min(255, std::max(0, b + n));
+      img[y * w + x] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+  }
+}
+
+// FNV-1a of the labels followed by their count
+static uint64 HashLabels(const std::vector<int> &labels, const int numLabels) {
+  uint64 hash = 14695981039346656037ULL;
+  for(size_t i = 0; i <= labels.size(); i++) {
+    hash ^= static_cast<uint32>(i < labels.size() ? labels[i] : numLabels);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Labels of the reference LAB conversion, hashed with the iteration that
+// kept full-image distance buffers. Chunking the assignment step must not
+// change a single label, with either precision or API, on any thread count,
+// or with early termination or the active set.
+static bool TestReferenceLabels() {
+  const int w = 301, h = 203;
+  std::vector<unsigned int> img;
+  GenerateReferenceImage(w, h, img);
+
+  std::vector<int> labels(w * h);
+  int n;
+  bool ok = true;
+
+  SLIC<float> slicFloat;
+  slicFloat.SetFastLABConversion(false);
+  slicFloat.PerformSLICO_ForGivenStepSize(&img[0], w, h, &labels[0], n, 7, 10.0, 2);
+  ok = ok && HashLabels(labels, n) == 0xa22f3ae70e8d1b60ULL;
+
+  SLIC<double> slicStep;
+  slicStep.SetFastLABConversion(false);
+  slicStep.PerformSLICO_ForGivenStepSize(&img[0], w, h, &labels[0], n, 7, 10.0);
+  ok = ok && HashLabels(labels, n) == 0xc359dc67eee3585aULL;
+
+  SLIC<double> slicK;
+  slicK.SetFastLABConversion(false);
+  slicK.PerformSLICO_ForGivenK(&img[0], w, h, &labels[0], n, 500, 10.0, 3);
+  ok = ok && HashLabels(labels, n) == 0x01bf98a102c81fbbULL;
+
+  SLIC<double> slicConvergence;
+  slicConvergence.SetFastLABConversion(false);
+  slicConvergence.SetConvergenceThresholds(0.01, 0.25);
+  slicConvergence.PerformSLICO_ForGivenStepSize(&img[0], w, h, &labels[0], n, 7, 10.0, 2);
+  ok = ok && HashLabels(labels, n) == 0x287d20b0bb69b95dULL;
+
+  SLIC<double> slicActive;
+  slicActive.SetFastLABConversion(false);
+  slicActive.SetActiveSetIterations(true);
+  slicActive.PerformSLICO_ForGivenStepSize(&img[0], w, h, &labels[0], n, 7, 10.0, 2);
+  ok = ok && HashLabels(labels, n) == 0xd70e105054157e69ULL;
+
+  std::cout << "Labels match the full-image buffer reference: " << (ok ? "yes" : "no")
+            << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestWarmStart() {
+  const int w = 1024, h = 1024, step = 8, numFrames = 12;
+  std::vector<unsigned int> img;
+  std::vector<int> cold(w * h), warm(w * h);
+  int nCold, nWarm;
+  StopWatch stopwatch;
+
+  SLIC<float> slicCold, slicWarm;
+  slicWarm.SetWarmStart(true);
+
+  double timeCold = 0, timeWarm = 0, errorCold = 0, errorWarm = 0;
+  int itrCold = 0, itrWarm = 0;
+  bool firstIdentical = false;
+  for(int frame = 0; frame < numFrames; frame++) {
+    GenerateImage(w, h, img, frame);
+
+    stopwatch.Reset();
+    stopwatch.Start();
+    slicCold.PerformSLICO_ForGivenStepSize(&img[0], w, h, &cold[0], nCold, step, 1.0);
+    stopwatch.Stop();
+    const double frameCold = stopwatch.TimeInMilliseconds();
+
+    stopwatch.Reset();
+    stopwatch.Start();
+    slicWarm.PerformSLICO_ForGivenStepSize(&img[0], w, h, &warm[0], nWarm, step, 1.0);
+    stopwatch.Stop();
+    const double frameWarm = stopwatch.TimeInMilliseconds();
+
+    // The first frame has nothing to start from
+    if(frame == 0) {
+      firstIdentical = nCold == nWarm && cold == warm;
+      continue;
+    }
+    timeCold += frameCold;
+    timeWarm += frameWarm;
+    itrCold += slicCold.GetNumIterations();
+    itrWarm += slicWarm.GetNumIterations();
+    errorCold += SegmentColorError(img, cold);
+    errorWarm += SegmentColorError(img, warm);
+  }
+
+  const int n = numFrames - 1;
+  std::cout << "Cold start: " << (double(itrCold) / n) << " iterations in "
+            << (timeCold / n) << " ms per frame" << std::endl;
+  std::cout << "Warm start: " << (double(itrWarm) / n) << " iterations in "
+            << (timeWarm / n) << " ms per frame" << std::endl;
+  std::cout << "Speedup: " << (timeCold / timeWarm) << "x" << std::endl;
+  std::cout << "Segment color error (cold, warm): " << (errorCold / n) << ", "
+            << (errorWarm / n) << std::endl;
+  std::cout << "First frame matches a cold start: " << (firstIdentical ? "yes" : "no")
+            << std::endl << std::endl;
+
+  return firstIdentical && itrWarm < itrCold && errorWarm < 1.05 * errorCold;
+}
+
+static bool TestPyramid() {
+  const int w = 2048, h = 2048, step = 16;
+  std::vector<unsigned int> img;
+  GenerateImage(w, h, img);
+
+  std::vector<int> full(w * h), pyramid(w * h), threeLevels;
+  int nFull, nPyramid;
+  StopWatch stopwatch;
+
+  SLIC<float> slicFull;
+  stopwatch.Start();
+  slicFull.PerformSLICO_ForGivenStepSize(&img[0], w, h, &full[0], nFull, step, 1.0);
+  stopwatch.Stop();
+  std::cout << "Full image: " << stopwatch.TimeInMilliseconds() << " ms, " << nFull
+            << " labels, color error " << SegmentColorError(img, full) << std::endl;
+
+  bool ok = true;
+  SLIC<float> slicPyramid;
+  for(int levels = 1; levels <= 4; levels++) {
+    stopwatch.Reset();
+    stopwatch.Start();
+    slicPyramid.PerformSLICO_ForGivenStepSize_Pyramid(&img[0], w, h, &pyramid[0], nPyramid,
+                                                      step, 1.0, levels);
+    stopwatch.Stop();
+    const double agreement = LabelAgreement(w, full, pyramid);
+    std::cout << levels << " levels: " << stopwatch.TimeInMilliseconds() << " ms, " << nPyramid
+              << " labels, color error " << SegmentColorError(img, pyramid) << ", agreement "
+              << (100.0 * agreement) << "%" << std::endl;
+    const std::vector<double> &timings = slicPyramid.GetLevelTimings();
+    std::cout << "  per level (ms):";
+    for(size_t l = 0; l < timings.size(); l++) {
+      std::cout << " " << timings[l];
+    }
+    std::cout << std::endl;
+
+    // A single level is the plain segmentation
+    if(levels == 1) {
+      ok = ok && nPyramid == nFull && pyramid == full;
+    }
+    if(levels == 3) {
+      threeLevels = pyramid;
+    }
+    ok = ok && nPyramid > 0.98 * nFull && agreement > 0.85;
+  }
+
+  // Levels beyond what the step allows are dropped, however many are asked for
+  slicPyramid.PerformSLICO_ForGivenStepSize_Pyramid(&img[0], w, h, &pyramid[0], nPyramid,
+                                                    step, 1.0, 1000);
+  const bool clamped = slicPyramid.GetLevelTimings().size() == 4;
+
+  // The refinement passes run in full even with warm starts on, whose early
+  // stop only applies to the plain entry points
+  SLIC<float> slicWarm;
+  slicWarm.SetWarmStart(true, 0.5);
+  slicWarm.PerformSLICO_ForGivenStepSize_Pyramid(&img[0], w, h, &pyramid[0], nPyramid,
+                                                 step, 1.0, 3);
+  const bool unaffected = pyramid == threeLevels;
+
+  std::cout << "Levels kept of 1000: " << slicPyramid.GetLevelTimings().size() << std::endl;
+  std::cout << "Warm start leaves refinement alone: " << (unaffected ? "yes" : "no")
+            << std::endl << std::endl;
+  return ok && clamped && unaffected;
+}
+
+// Number of pieces the labels split a volume into, connected through the
+// eight neighbours in a slice and the two in the slices above and below.
+static int CountVolumeComponents(const int w, const int h, const std::vector<int> &labels) {
+  const int sz = w * h, d = static_cast<int>(labels.size()) / sz;
+  std::vector<char> seen(labels.size(), 0);
+  std::vector<int> stack;
+  int components = 0;
+  for(int start = 0; start < sz * d; start++) {
+    if(seen[start]) {
+      continue;
+    }
+    components++;
+    seen[start] = 1;
+    stack.assign(1, start);
+    while(!stack.empty()) {
+      const int i = stack.back();
+      stack.pop_back();
+      const int x = i % w, y = (i % sz) / w, z = i / sz;
+      for(int dz = -1; dz <= 1; dz++) {
+        for(int dy = -1; dy <= 1; dy++) {
+          for(int dx = -1; dx <= 1; dx++) {
+            // In plane neighbours, or straight up and down
+            if((dx == 0 && dy == 0 && dz == 0) || (dz != 0 && (dx != 0 || dy != 0))) {
+              continue;
+            }
+            const int nx = x + dx, ny = y + dy, nz = z + dz;
+            if(nx < 0 || nx >= w || ny < 0 || ny >= h || nz < 0 || nz >= d) {
+              continue;
+            }
+            const int j = nz * sz + ny * w + nx;
+            if(!seen[j] && labels[j] == labels[i]) {
+              seen[j] = 1;
+              stack.push_back(j);
+            }
+          }
+        }
+      }
+    }
+  }
+  return components;
+}
+
+static bool TestSupervoxels() {
+  const int w = 256, h = 256, d = 32, step = 8, sz = w * h;
+  std::vector<unsigned int> volume(sz * d), slice;
+  for(int z = 0; z < d; z++) {
+    GenerateImage(w, h, slice, z);
+    std::copy(slice.begin(), slice.end(), volume.begin() + z * sz);
+  }
+  std::vector<const unsigned int *> slices(d);
+  for(int z = 0; z < d; z++) {
+    slices[z] = &volume[z * sz];
+  }
+
+  std::vector<int> serial(sz * d), threaded(sz * d), planar(sz * d);
+  std::vector<int *> serialSlices(d), threadedSlices(d);
+  for(int z = 0; z < d; z++) {
+    serialSlices[z] = &serial[z * sz];
+    threadedSlices[z] = &threaded[z * sz];
+  }
+  int nSerial, nThreaded, nPlanar;
+  StopWatch stopwatch;
+
+  SLIC<float> slicSerial;
+  stopwatch.Start();
+  slicSerial.PerformSLICO_ForGivenStepSize_Supervoxels(&slices[0], w, h, d, &serialSlices[0],
+                                                       nSerial, step, 1.0);
+  stopwatch.Stop();
+  const double timeVolume = stopwatch.TimeInMilliseconds();
+
+  SLIC<float> slicThreaded;
+  slicThreaded.PerformSLICO_ForGivenStepSize_Supervoxels(&slices[0], w, h, d, &threadedSlices[0],
+                                                         nThreaded, step, 1.0, 4);
+  const bool identical = nSerial == nThreaded && serial == threaded;
+
+  // The same slices segmented one at a time
+  SLIC<float> slicPlanar;
+  stopwatch.Reset();
+  stopwatch.Start();
+  for(int z = 0; z < d; z++) {
+    slicPlanar.PerformSLICO_ForGivenStepSize(slices[z], w, h, &planar[z * sz], nPlanar, step, 1.0);
+  }
+  stopwatch.Stop();
+  const double timeSlices = stopwatch.TimeInMilliseconds();
+
+  // Voxels that keep their label in the next slice
+  int kept = 0;
+  for(int i = 0; i < sz * (d - 1); i++) {
+    kept += serial[i] == serial[i + sz] ? 1 : 0;
+  }
+  const double persistence = static_cast<double>(kept) / static_cast<double>(sz * (d - 1));
+  const int components = CountVolumeComponents(w, h, serial);
+
+  std::cout << "Supervoxels: " << nSerial << " in " << timeVolume << " ms, "
+            << (components == nSerial ? "connected" : "not connected") << std::endl;
+  std::cout << "Slice by slice: " << timeSlices << " ms" << std::endl;
+  std::cout << "Labels kept from slice to slice: " << (100.0 * persistence) << "%" << std::endl;
+  std::cout << "Threaded supervoxels match serial: " << (identical ? "yes" : "no")
+            << std::endl << std::endl;
+
+  return identical && components == nSerial && persistence > 0.5;
+}
+
+// Neighbour-pair agreement of a tiled and a whole image segmentation, split
+// by whether the pair lies within one step of a tile seam.
+static void SeamAgreement(const int w, const int tileSize, const int step,
+                          const std::vector<int> &whole, const std::vector<int> &tiled,
+                          double &interior, double &seams) {
+  const int h = static_cast<int>(whole.size()) / w;
+  uint32 same[2] = { 0, 0 }, total[2] = { 0, 0 };
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      const int i = y * w + x;
+      const int dx = std::min(x % tileSize, tileSize - 1 - x % tileSize);
+      const int dy = std::min(y % tileSize, tileSize - 1 - y % tileSize);
+      const int seam = (dx < step || dy < step) ? 1 : 0;
+      if(x + 1 < w) {
+        same[seam] += ((whole[i] == whole[i + 1]) == (tiled[i] == tiled[i + 1])) ? 1 : 0;
+        total[seam]++;
+      }
+      if(y + 1 < h) {
+        same[seam] += ((whole[i] == whole[i + w]) == (tiled[i] == tiled[i + w])) ? 1 : 0;
+        total[seam]++;
+      }
+    }
+  }
+  interior = static_cast<double>(same[0]) / static_cast<double>(total[0]);
+  seams = static_cast<double>(same[1]) / static_cast<double>(total[1]);
+}
+
+static bool TestTiledSeams() {
+  const int w = 1280, h = 1024, step = 8, tileSize = 256;
+  std::vector<unsigned int> img;
+  GenerateImage(w, h, img);
+
+  std::vector<int> whole(w * h), tiled(w * h);
+  int nWhole, nTiled;
+
+  SLIC<float> slic;
+  slic.PerformSLICO_ForGivenStepSize(&img[0], w, h, &whole[0], nWhole, step, 1.0);
+  std::cout << "Labels (whole): " << nWhole << std::endl;
+
+  bool ok = true;
+  for(int halo = 2 * step; halo <= 4 * step; halo *= 2) {
+    slic.PerformSLICO_ForGivenStepSize_Tiled(&img[0], w, h, &tiled[0], nTiled, step, 1.0, tileSize, halo);
+
+    double interior, seams;
+    SeamAgreement(w, tileSize, step, whole, tiled, interior, seams);
+    int maxLabel = *std::max_element(tiled.begin(), tiled.end());
+    int components = CountComponents(w, tiled);
+
+    std::cout << "Halo " << halo << ": " << nTiled << " labels, "
+              << (components == nTiled ? "connected" : "not connected") << std::endl;
+    std::cout << "Label agreement away from seams: " << (100.0 * interior) << "%" << std::endl;
+    std::cout << "Label agreement at seams: " << (100.0 * seams) << "%" << std::endl;
+
+    // The narrowest halo still lets the tile borders pull on the seams a
+    // little; twice that has to be as good as the rest of the image.
+    const double minSeams = (halo == 2 * step) ? 0.95 : interior - 0.005;
+    ok = ok && maxLabel == nTiled - 1 && components == nTiled && seams > minSeams &&
+         std::abs(nTiled - nWhole) < nWhole / 100;
+  }
+  std::cout << std::endl;
+  return ok;
+}
+
+// The serial flood fill EnforceLabelConnectivity used before the band
+// parallel union-find.
+static void FloodFillConnectivity(const int *labels, const int width, const int height,
+                                  int *nlabels, int &numlabels, const int K) {
+  const int dx4[4] = {-1,  0,  1,  0};
+  const int dy4[4] = { 0, -1,  0,  1};
+
+  const int sz = width * height;
+  const int SUPSZ = sz / K;
+  std::vector<int> xvec(sz), yvec(sz);
+  for(int i = 0; i < sz; i++) {
+    nlabels[i] = -1;
+  }
+
+  int label = 0, oindex = 0, adjlabel = 0;
+  for(int j = 0; j < height; j++) {
+    for(int k = 0; k < width; k++, oindex++) {
+      if(nlabels[oindex] >= 0) {
+        continue;
+      }
+
+      // Start a new segment, and remember a neighbour to give it to if small
+      nlabels[oindex] = label;
+      xvec[0] = k;
+      yvec[0] = j;
+      for(int n = 0; n < 4; n++) {
+        const int x = k + dx4[n], y = j + dy4[n];
+        if(x >= 0 && x < width && y >= 0 && y < height && nlabels[y * width + x] >= 0) {
+          adjlabel = nlabels[y * width + x];
+        }
+      }
+
+      int count = 1;
+      for(int c = 0; c < count; c++) {
+        for(int n = 0; n < 4; n++) {
+          const int x = xvec[c] + dx4[n], y = yvec[c] + dy4[n];
+          if(x >= 0 && x < width && y >= 0 && y < height) {
+            const int nindex = y * width + x;
+            if(nlabels[nindex] < 0 && labels[oindex] == labels[nindex]) {
+              xvec[count] = x;
+              yvec[count] = y;
+              nlabels[nindex] = label;
+              count++;
+            }
+          }
+        }
+      }
+
+      if(count <= SUPSZ >> 2) {
+        for(int c = 0; c < count; c++) {
+          nlabels[yvec[c] * width + xvec[c]] = adjlabel;
+        }
+        label--;
+      }
+      label++;
+    }
+  }
+  numlabels = label;
+}
+
+// Blocks of a few values with some stray pixels, so that there are
+// components of every size and shape, many of them crossing band boundaries.
+static void GenerateRandomLabels(const int w, const int h, std::vector<int> &labels) {
+  const int cell = 1 + rand() % 8;
+  const int numValues = 1 + rand() % 6;
+  const int cols = (w + cell - 1) / cell, rows = (h + cell - 1) / cell;
+  std::vector<int> grid(cols * rows);
+  for(size_t i = 0; i < grid.size(); i++) {
+    grid[i] = rand() % numValues;
+  }
+
+  labels.resize(w * h);
+  for(int y = 0; y < h; y++) {
+    for(int x = 0; x < w; x++) {
+      labels[y * w + x] = rand() % 8 == 0 ? rand() % numValues : grid[(y / cell) * cols + x / cell];
+    }
+  }
+}
+
+static bool TestConnectivity() {
+  const int numMaps = 400;
+  bool ok = true;
+  std::vector<int> labels, reference, nlabels;
+  for(int m = 0; ok && m < numMaps; m++) {
+    // Up to 70 pixels a side, so that bands of up to 8 threads are often
+    // only a row or two high, and sometimes there are fewer rows than threads.
+    const int w = 1 + rand() % 70, h = 1 + rand() % 70;
+    const int K = 1 + rand() % (w * h);
+    GenerateRandomLabels(w, h, labels);
+
+    int nReference;
+    reference.resize(w * h);
+    FloodFillConnectivity(&labels[0], w, h, &reference[0], nReference, K);
+
+    for(int numThreads = 1; ok && numThreads <= 8; numThreads++) {
+      SLIC<float> slic;
+      int n;
+      nlabels.assign(w * h, -1);
+      slic.EnforceLabelConnectivity(&labels[0], w, h, &nlabels[0], n, K, numThreads);
+      ok = n == nReference && nlabels == reference;
+    }
+  }
+
+  std::cout << "Connectivity matches the flood fill on " << numMaps << " label maps, "
+            << "1 to 8 threads: " << (ok ? "yes" : "no") << std::endl << std::endl;
+  return ok;
+}
+
+static bool TestWorkspace() {
+  const int sizes[3][2] = { { 640, 480 }, { 300, 900 }, { 1024, 512 } };
+  std::vector<unsigned int> img[3];
+  std::vector<int> labels[3], reference[3];
+  for(int j = 0; j < 3; j++) {
+    GenerateImage(sizes[j][0], sizes[j][1], img[j]);
+    labels[j].resize(sizes[j][0] * sizes[j][1]);
+    reference[j].resize(sizes[j][0] * sizes[j][1]);
+  }
+
+  SLICWorkspace<float> workspace;
+  bool identical = true;
+  uint32 allocations[2] = { 0, 0 };
+  for(int numThreads = 1; numThreads <= 4; numThreads += 3) {
+    SLIC<float> slic;
+    slic.SetWorkspace(&workspace);
+    slic.SetActiveSetIterations(numThreads > 1);
+
+    // The first pass grows the workspace, the second must not allocate
+    for(int pass = 0; pass < 2; pass++) {
+      const uint32 before = gNumAllocations;
+      for(int j = 0; j < 3; j++) {
+        const int w = sizes[j][0], h = sizes[j][1];
+        int n;
+        slic.PerformSLICO_ForGivenStepSize(&img[j][0], w, h, &labels[j][0], n, 6, 1.0, numThreads);
+        slic.PerformSLICO_ForGivenK(&img[j][0], w, h, &labels[j][0], n, 1500, 1.0, numThreads);
+      }
+      if(pass == 1) {
+        allocations[numThreads > 1] = gNumAllocations - before;
+      }
+    }
+
+    // Reusing a workspace must not change the result
+    for(int j = 0; j < 3; j++) {
+      int n;
+      SLIC<float> fresh;
+      fresh.SetActiveSetIterations(numThreads > 1);
+      fresh.PerformSLICO_ForGivenK(&img[j][0], sizes[j][0], sizes[j][1], &reference[j][0], n, 1500, 1.0, numThreads);
+      identical = identical && reference[j] == labels[j];
+    }
+  }
+
+  std::cout << "Allocations in steady state (1 thread, 4 threads): " << allocations[0] << ", "
+            << allocations[1] << std::endl;
+  std::cout << "Workspace results match fresh objects: " << (identical ? "yes" : "no")
+            << std::endl << std::endl;
+  return identical && allocations[0] == 0 && allocations[1] == 0;
+}
+
+// Seeding as it was before DetectLabEdge: the grid, then a gradient
+// for every pixel of the image, then each seed moved to the lowest one
+// among its eight neighbours.
+template<typename T>
+static void ReferenceSeeds(const std::vector<unsigned int> &img, const int w, const int h,
+                           const int step, std::vector<T> seeds[5]) {
+  const int sz = w * h;
+  std::vector<T> lvec(sz), avec(sz), bvec(sz);
+  SLIC<T> slic;
+  slic.ConvertRGBtoLAB(&img[0], sz, &lvec[0], &avec[0], &bvec[0]);
+
+  std::vector<T> edges(sz, 0);
+  for(int j = 1; j < h - 1; j++) {
+    for(int k = 1; k < w - 1; k++) {
+      const int i = j * w + k;
+      const double dx = (lvec[i - 1] - lvec[i + 1]) * (lvec[i - 1] - lvec[i + 1]) +
+        (avec[i - 1] - avec[i + 1]) * (avec[i - 1] - avec[i + 1]) +
+        (bvec[i - 1] - bvec[i + 1]) * (bvec[i - 1] - bvec[i + 1]);
+      const double dy = (lvec[i - w] - lvec[i + w]) * (lvec[i - w] - lvec[i + w]) +
+        (avec[i - w] - avec[i + w]) * (avec[i - w] - avec[i + w]) +
+        (bvec[i - w] - bvec[i + w]) * (bvec[i - w] - bvec[i + w]);
+      edges[i] = static_cast<T>(dx + dy);
+    }
+  }
+
+  const int xstrips = static_cast<int>(0.5 + double(w) / double(step));
+  const int ystrips = static_cast<int>(0.5 + double(h) / double(step));
+  const double xerrperstrip = double(w - step * xstrips) / double(xstrips);
+  const double yerrperstrip = double(h - step * ystrips) / double(ystrips);
+  for(int c = 0; c < 5; c++) {
+    seeds[c].clear();
+  }
+
+  const int dx8[8] = {-1, -1,  0,  1, 1, 1, 0, -1};
+  const int dy8[8] = { 0, -1, -1, -1, 0, 1, 1,  1};
+  for(int y = 0; y < ystrips; y++) {
+    for(int x = 0; x < xstrips; x++) {
+      const int ox = std::min(x * step + step / 2 + static_cast<int>(x * xerrperstrip), w - 1);
+      const int oy = std::min(y * step + step / 2 + static_cast<int>(y * yerrperstrip), h - 1);
+
+      int best = oy * w + ox;
+      for(int n = 0; n < 8; n++) {
+        const int nx = ox + dx8[n], ny = oy + dy8[n];
+        if(nx >= 0 && nx < w && ny >= 0 && ny < h && edges[ny * w + nx] < edges[best]) {
+          best = ny * w + nx;
+        }
+      }
+
+      seeds[0].push_back(lvec[best]);
+      seeds[1].push_back(avec[best]);
+      seeds[2].push_back(bvec[best]);
+      seeds[3].push_back(static_cast<T>(best % w));
+      seeds[4].push_back(static_cast<T>(best / w));
+    }
+  }
+}
+
+template<typename T>
+static bool SameSeeds(const std::vector<unsigned int> &img, const int w, const int h,
+                      const int step) {
+  std::vector<T> expected[5], seeds[5];
+  ReferenceSeeds(img, w, h, step, expected);
+
+  SLIC<T> slic;
+  slic.GetSeeds_ForGivenStepSize(&img[0], w, h, step, seeds[0], seeds[1], seeds[2],
+                                 seeds[3], seeds[4]);
+  bool same = true;
+  for(int c = 0; c < 5; c++) {
+    same = same && seeds[c] == expected[c];
+  }
+  return same;
+}
+
+static bool TestSeeds() {
+  // Sizes where the grid rounding used to put the last seeds one pixel past
+  // the image with step 2, then ones picked at random.
+  const int kEdgeSizes[][3] = {
+    { 5, 5, 2 }, { 5, 9, 2 }, { 9, 5, 2 }, { 13, 21, 2 }, { 101, 67, 2 }, { 37, 45, 3 }
+  };
+  const int numEdgeSizes = sizeof(kEdgeSizes) / sizeof(kEdgeSizes[0]);
+  const int numImages = 120;
+
+  bool ok = true;
+  std::vector<unsigned int> img;
+  for(int i = 0; i < numEdgeSizes + numImages; i++) {
+    int w, h, step;
+    if(i < numEdgeSizes) {
+      w = kEdgeSizes[i][0];
+      h = kEdgeSizes[i][1];
+      step = kEdgeSizes[i][2];
+    } else {
+      w = 3 + rand() % 300;
+      h = 3 + rand() % 300;
+      step = 2 + rand() % (std::min(w, h) - 1);
+    }
+    GenerateImage(w, h, img);
+    ok = ok && SameSeeds<float>(img, w, h, step) && SameSeeds<double>(img, w, h, step);
+  }
+
+  std::cout << "Seeds match full-image edge detection on " << (numEdgeSizes + numImages)
+            << " images: " << (ok ? "yes" : "no") << std::endl << std::endl;
+  return ok;
+}
+
+static int CountOccurrences(const std::string &s, const std::string &what) {
+  int n = 0;
+  for(size_t i = s.find(what); i != std::string::npos; i = s.find(what, i + 1)) {
+    n++;
+  }
+  return n;
+}
+
+static bool TestTrace() {
+  const int w = 1024, h = 768, step = 8, numThreads = 4;
+  const char *kTraceFile = "slic_test_trace.json";
+  std::vector<unsigned int> img;
+  std::vector<int> labels(w * h);
+  GenerateImage(w, h, img);
+
+  // The cost of a span while tracing is off
+  const int kNumSpans = 10000000;
+  StopWatch stopwatch;
+  stopwatch.Start();
+  for(int i = 0; i < kNumSpans; i++) {
+    TraceSpan span("off");
+  }
+  stopwatch.Stop();
+  const double offCost = stopwatch.TimeInMilliseconds() * 1e6 / kNumSpans;
+
+  int n;
+  SLIC<float> slic;
+  Trace::Enable();
+  slic.PerformSLICO_ForGivenStepSize(&img[0], w, h, &labels[0], n, step, 1.0, numThreads);
+  Trace::Disable();
+  bool ok = Trace::Write(kTraceFile);
+
+  std::string trace;
+  FILE *f = fopen(kTraceFile, "rb");
+  for(int ch; f && (ch = fgetc(f)) != EOF; ) {
+    trace.push_back(static_cast<char>(ch));
+  }
+  if(f) {
+    fclose(f);
+  }
+  remove(kTraceFile);
+
+  // Every thread of the pool records its assignment bands
+  const int numItr = slic.GetNumIterations();
+  const int numTracks = CountOccurrences(trace, "\"thread_name\"");
+  ok = ok && trace.find("{\"displayTimeUnit\"") == 0;
+  ok = ok && CountOccurrences(trace, "\"SLIC::PerformSLICO_ForGivenStepSize\"") == 1;
+  ok = ok && CountOccurrences(trace, "\"slic.iteration\"") == numItr;
+  ok = ok && CountOccurrences(trace, "\"slic.assign\"") == numItr * numThreads;
+  ok = ok && numTracks == numThreads;
+  ok = ok && CountOccurrences(trace, "\"off\"") == 0;
+
+  std::cout << "Span cost with tracing off: " << offCost << " ns" << std::endl;
+  std::cout << "Trace of a " << numThreads << " thread segmentation: " << numTracks
+            << " threads, " << CountOccurrences(trace, "\"ph\":\"X\"") << " spans" << std::endl;
+  std::cout << "Spans match the work done: " << (ok ? "yes" : "no") << std::endl << std::endl;
+  return ok;
+}
+
+int main() {
+  srand(0);
+
+  bool ok = true;
+  ok = TestLABConversion() && ok;
+  ok = TestLABLabelDrift() && ok;
+  ok = TestPrecision() && ok;
+  ok = TestThreadedAssignment() && ok;
+  ok = TestConvergence() && ok;
+  ok = TestActiveSet() && ok;
+  ok = TestReferenceLabels() && ok;
+  ok = TestWarmStart() && ok;
+  ok = TestPyramid() && ok;
+  ok = TestSupervoxels() && ok;
+  ok = TestTiledSeams() && ok;
+  ok = TestConnectivity() && ok;
+  ok = TestWorkspace() && ok;
+  ok = TestSeeds() && ok;
+  ok = TestTrace() && ok;
+
+  std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
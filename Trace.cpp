@@ -0,0 +1,213 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#include "Trace.h"
+#include "JSON.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::s_Enabled(false);
+
+typedef std::chrono::steady_clock TraceClock;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Per thread buffers
+//
+// A thread appends its spans to a list of fixed size chunks that only it
+// writes. The event count of a chunk and the link to the next one are
+// published with release stores, so Write() can read the buffers of running
+// threads without locking them. Buffers outlive their threads.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+struct TraceEvent {
+  const char *name;
+  uint64 start;
+  uint64 end;
+};
+
+struct TraceChunk {
+  static const uint32 kNumEvents = 4096;
+
+  TraceEvent events[kNumEvents];
+  std::atomic<uint32> count;
+  std::atomic<TraceChunk *> next;
+
+  TraceChunk() : count(0), next(NULL) { }
+};
+
+struct TraceBuffer {
+  uint32 tid;
+  TraceChunk head;
+  TraceChunk *tail;
+
+  explicit TraceBuffer(uint32 t) : tid(t), tail(&head) { }
+};
+
+// Registration takes a lock, but only once per thread. The registry is
+// never destroyed, so threads that outlive main() can still record.
+struct TraceRegistry {
+  std::mutex mutex;
+  std::vector<TraceBuffer *> buffers;
+  TraceClock::time_point origin;
+  bool started;
+
+  TraceRegistry() : started(false) { }
+};
+
+static TraceRegistry &Registry() {
+  static TraceRegistry *registry = new TraceRegistry;
+  return *registry;
+}
+
+static TraceBuffer &ThreadBuffer() {
+  static thread_local TraceBuffer *buffer = NULL;
+  if(!buffer) {
+    TraceRegistry &registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    buffer = new TraceBuffer(static_cast<uint32>(registry.buffers.size()));
+    registry.buffers.push_back(buffer);
+  }
+  return *buffer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Trace
+//
+////////////////////////////////////////////////////////////////////////////////
+
+void Trace::Enable() {
+  TraceRegistry &registry = Registry();
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if(!registry.started) {
+      registry.origin = TraceClock::now();
+      registry.started = true;
+    }
+  }
+  s_Enabled.store(true, std::memory_order_release);
+}
+
+void Trace::Disable() {
+  s_Enabled.store(false, std::memory_order_relaxed);
+}
+
+uint64 Trace::Now() {
+  return ToTraceTime(TraceClock::now());
+}
+
+uint64 Trace::ToTraceTime(const TraceClock::time_point &t) {
+  // Enable() sets the origin before spans can see tracing enabled
+  const TraceClock::duration elapsed = t - Registry().origin;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void Trace::Record(const char *name, uint64 start, uint64 end) {
+  TraceBuffer &buffer = ThreadBuffer();
+  TraceChunk *chunk = buffer.tail;
+  uint32 count = chunk->count.load(std::memory_order_relaxed);
+  if(count == TraceChunk::kNumEvents) {
+    TraceChunk *next = new TraceChunk;
+    chunk->next.store(next, std::memory_order_release);
+    buffer.tail = chunk = next;
+    count = 0;
+  }
+
+  TraceEvent &event = chunk->events[count];
+  event.name = name;
+  event.start = start;
+  event.end = end;
+  chunk->count.store(count + 1, std::memory_order_release);
+}
+
+bool Trace::Write(const std::string &filename) {
+  FILE *f = fopen(filename.c_str(), "w");
+  if(!f) {
+    return false;
+  }
+
+  std::vector<TraceBuffer *> buffers;
+  {
+    TraceRegistry &registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    buffers = registry.buffers;
+  }
+
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  bool first = true;
+  for(const TraceBuffer *buffer : buffers) {
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+            "\"args\":{\"name\":\"thread %u\"}}", first ? "" : ",", buffer->tid, buffer->tid);
+    first = false;
+
+    const TraceChunk *chunk = &buffer->head;
+    while(chunk) {
+      const uint32 count = chunk->count.load(std::memory_order_acquire);
+      for(uint32 i = 0; i < count; i++) {
+        const TraceEvent &event = chunk->events[i];
+        fprintf(f, ",\n{\"name\":");
+        WriteJSONString(f, event.name);
+        fprintf(f, ",\"cat\":\"sc\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                buffer->tid, event.start * 1e-3, (event.end - event.start) * 1e-3);
+      }
+      chunk = chunk->next.load(std::memory_order_acquire);
+    }
+  }
+  fprintf(f, "\n]}\n");
+
+  return fclose(f) == 0;
+}
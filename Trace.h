@@ -0,0 +1,115 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#ifndef _TRACE_H__
+#define _TRACE_H__
+
+#include "TexCompTypes.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Timeline spans for chrome://tracing and Perfetto, written as Chrome
+// trace_event JSON. Each thread records its spans into a buffer of its own
+// without locking. While tracing is off, a span costs one load and a
+// branch.
+class Trace {
+ public:
+  // Starts or stops recording. Spans recorded so far are kept.
+  static void Enable();
+  static void Disable();
+
+  static bool IsEnabled() {
+    return s_Enabled.load(std::memory_order_acquire);
+  }
+
+  // Nanoseconds since tracing was first enabled, now or at time t.
+  static uint64 Now();
+  static uint64 ToTraceTime(const std::chrono::steady_clock::time_point &t);
+
+  // Records a span of the calling thread. name must outlive the trace.
+  static void Record(const char *name, uint64 start, uint64 end);
+
+  // Writes every span recorded so far as complete ("X") events, one track
+  // per thread. Spans still being recorded by other threads may be left
+  // out, but are never torn.
+  static bool Write(const std::string &filename);
+
+ private:
+  static std::atomic<bool> s_Enabled;
+};
+
+// Records a span from construction to destruction, if tracing was enabled
+// when it started.
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char *name)
+    : m_Name(Trace::IsEnabled() ? name : NULL)
+    , m_Start(m_Name ? Trace::Now() : 0)
+  { }
+
+  ~TraceSpan() {
+    if(m_Name) {
+      Trace::Record(m_Name, m_Start, Trace::Now());
+    }
+  }
+
+ private:
+  TraceSpan(const TraceSpan &);
+  TraceSpan &operator=(const TraceSpan &);
+
+  const char *m_Name;
+  uint64 m_Start;
+};
+
+#endif // _TRACE_H__
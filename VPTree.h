@@ -78,6 +78,16 @@ class VpTree
   };
   
  public:
+  // Work done by search() since the tree was made or resetStats(). Each
+  // node visited costs one distance evaluation; a subtree is pruned when
+  // the distance to its vantage point rules it out.
+  struct SearchStats {
+    size_t searches;
+    size_t nodesVisited;
+    size_t subtreesPruned;
+    SearchStats() : searches(0), nodesVisited(0), subtreesPruned(0) {}
+  };
+
  VpTree() : _root(0), _heap(20) {}
 
   ~VpTree() {
@@ -95,6 +105,7 @@ class VpTree
   {
     _heap.clear();
     _tau = std::numeric_limits<double>::max();
+    _stats.searches++;
     search( _root, target, k );
 
     results->clear();
@@ -116,9 +127,13 @@ class VpTree
       std::reverse( distances->begin(), distances->end() );
   }
 
+  const SearchStats &stats() const { return _stats; }
+  void resetStats() { _stats = SearchStats(); }
+
  private:
   std::vector<T> _items;
   double _tau;
+  SearchStats _stats;
 
     struct Node 
     {
@@ -195,6 +210,7 @@ class VpTree
     {
       if ( node == NULL ) return;
 
+      _stats.nodesVisited++;
       double dist = distance( _items[node->index], target );
       //printf("dist=%g tau=%gn", dist, _tau );
 
@@ -211,19 +227,27 @@ class VpTree
       if ( dist < node->threshold ) {
         if ( dist - _tau <= node->threshold ) {
           search( node->left, target, k );
+        } else if ( node->left ) {
+          _stats.subtreesPruned++;
         }
 
         if ( dist + _tau >= node->threshold ) {
           search( node->right, target, k );
+        } else if ( node->right ) {
+          _stats.subtreesPruned++;
         }
 
       } else {
         if ( dist + _tau >= node->threshold ) {
           search( node->right, target, k );
+        } else if ( node->right ) {
+          _stats.subtreesPruned++;
         }
 
         if ( dist - _tau <= node->threshold ) {
           search( node->left, target, k );
+        } else if ( node->left ) {
+          _stats.subtreesPruned++;
         }
       }
     }
@@ -115,6 +115,10 @@ int main() {
   }
   stopwatch.Stop();
   std::cout << "Time: (" << (stopwatch.TimeInMilliseconds() / 100.0) << " ms)" << std::endl;
+  const VpTree<uint32, Hamming>::SearchStats &stats = vptree.stats();
+  std::cout << std::dec << "Per search: " << (stats.nodesVisited / stats.searches) << " of " << kNumVals
+            << " nodes visited, " << (stats.subtreesPruned / stats.searches)
+            << " subtrees pruned" << std::endl;
   for(unsigned int i = 0; i < results.size(); i++) {
     std::cout << std::dec << i << " (" << Hamming(results[i], target) << "): 0x" << std::hex << results[i] << std::endl;
   }
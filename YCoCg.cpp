@@ -0,0 +1,193 @@
+/* FasTC
+ * Copyright (c) 2014 University of North Carolina at Chapel Hill.
+ * All rights reserved.
+ *
+ * Permission to use, copy, modify, and distribute this software and its
+ * documentation for educational, research, and non-profit purposes, without
+ * fee, and without a written agreement is hereby granted, provided that the
+ * above copyright notice, this paragraph, and the following four paragraphs
+ * appear in all copies.
+ *
+ * Permission to incorporate this software into commercial products may be
+ * obtained by contacting the authors or the Office of Technology Development
+ * at the University of North Carolina at Chapel Hill <otd@unc.edu>.
+ *
+ * This software program and documentation are copyrighted by the University of
+ * North Carolina at Chapel Hill. The software program and documentation are
+ * supplied "as is," without any accompanying services from the University of
+ * North Carolina at Chapel Hill or the authors. The University of North
+ * Carolina at Chapel Hill and the authors do not warrant that the operation of
+ * the program will be uninterrupted or error-free. The end-user understands
+ * that the program was developed for research purposes and is advised not to
+ * rely exclusively on the program for any reason.
+ *
+ * IN NO EVENT SHALL THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL OR THE
+ * AUTHORS BE LIABLE TO ANY PARTY FOR DIRECT, INDIRECT, SPECIAL, INCIDENTAL,
+ * OR CONSEQUENTIAL DAMAGES, INCLUDING LOST PROFITS, ARISING OUT OF THE USE OF
+ * THIS SOFTWARE AND ITS DOCUMENTATION, EVEN IF THE UNIVERSITY OF NORTH CAROLINA
+ * AT CHAPEL HILL OR THE AUTHORS HAVE BEEN ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * THE UNIVERSITY OF NORTH CAROLINA AT CHAPEL HILL AND THE AUTHORS SPECIFICALLY
+ * DISCLAIM ANY WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE AND ANY 
+ * STATUTORY WARRANTY OF NON-INFRINGEMENT. THE SOFTWARE PROVIDED HEREUNDER IS ON
+ * AN "AS IS" BASIS, AND THE UNIVERSITY  OF NORTH CAROLINA AT CHAPEL HILL AND
+ * THE AUTHORS HAVE NO OBLIGATIONS TO PROVIDE MAINTENANCE, SUPPORT, UPDATES, 
+ * ENHANCEMENTS, OR MODIFICATIONS.
+ *
+ * Please send all BUG REPORTS to <pavel@cs.unc.edu>.
+ *
+ * The authors may be contacted via:
+ *
+ * Pavel Krajcevski
+ * Dept of Computer Science
+ * 201 S Columbia St
+ * Frederick P. Brooks, Jr. Computer Science Bldg
+ * Chapel Hill, NC 27599-3175
+ * USA
+ * 
+ * <http://gamma.cs.unc.edu/FasTC/>
+ */
+
+#include "YCoCg.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE4_1__)
+#  include <smmintrin.h>
+#endif
+
+static inline uint8 ClampChannel(const int x) {
+  return static_cast<uint8>(std::max(0, std::min(255, x)));
+}
+
+void RGBToYCoCg(const uint32 *argb, const uint32 n,
+                int16 *y, int16 *co, int16 *cg) {
+  uint32 i = 0;
+#if defined(__AVX2__)
+  const __m256i mask = _mm256_set1_epi32(0xFF);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i half = _mm256_set1_epi32(128);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i two = _mm256_set1_epi32(2);
+  for(; i + 16 <= n; i += 16) {
+    __m256i vy[2], vco[2], vcg[2];
+    for(int k = 0; k < 2; k++) {
+      const __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(argb + i + 8*k));
+      const __m256i r = _mm256_and_si256(_mm256_srli_epi32(px, 16), mask);
+      const __m256i g2 = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask), 1);
+      const __m256i b = _mm256_and_si256(px, mask);
+      const __m256i rb = _mm256_add_epi32(r, b);
+
+      // The channels are clamped like YCoCgPixel does, although only Co
+      // and Cg of pure colors ever leave [0, 255].
+      vy[k] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(rb, g2), two), 2);
+      vco[k] = _mm256_add_epi32(_mm256_srai_epi32(
+        _mm256_add_epi32(_mm256_sub_epi32(r, b), one), 1), half);
+      vcg[k] = _mm256_add_epi32(_mm256_srai_epi32(
+        _mm256_add_epi32(_mm256_sub_epi32(g2, rb), two), 2), half);
+      vco[k] = _mm256_min_epi32(_mm256_max_epi32(vco[k], zero), mask);
+      vcg[k] = _mm256_min_epi32(_mm256_max_epi32(vcg[k], zero), mask);
+    }
+
+    // Packs work within 128 bit lanes, so put the halves back in order.
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(y + i),
+      _mm256_permute4x64_epi64(_mm256_packs_epi32(vy[0], vy[1]), 0xD8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(co + i),
+      _mm256_permute4x64_epi64(_mm256_packs_epi32(vco[0], vco[1]), 0xD8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(cg + i),
+      _mm256_permute4x64_epi64(_mm256_packs_epi32(vcg[0], vcg[1]), 0xD8));
+  }
+#elif defined(__SSE4_1__)
+  const __m128i mask = _mm_set1_epi32(0xFF);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i half = _mm_set1_epi32(128);
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i two = _mm_set1_epi32(2);
+  for(; i + 8 <= n; i += 8) {
+    __m128i vy[2], vco[2], vcg[2];
+    for(int k = 0; k < 2; k++) {
+      const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(argb + i + 4*k));
+      const __m128i r = _mm_and_si128(_mm_srli_epi32(px, 16), mask);
+      const __m128i g2 = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(px, 8), mask), 1);
+      const __m128i b = _mm_and_si128(px, mask);
+      const __m128i rb = _mm_add_epi32(r, b);
+
+      vy[k] = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(rb, g2), two), 2);
+      vco[k] = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(r, b), one), 1), half);
+      vcg[k] = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(g2, rb), two), 2), half);
+      vco[k] = _mm_min_epi32(_mm_max_epi32(vco[k], zero), mask);
+      vcg[k] = _mm_min_epi32(_mm_max_epi32(vcg[k], zero), mask);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(y + i), _mm_packs_epi32(vy[0], vy[1]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(co + i), _mm_packs_epi32(vco[0], vco[1]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(cg + i), _mm_packs_epi32(vcg[0], vcg[1]));
+  }
+#endif
+
+  for(; i < n; i++) {
+    const int r = (argb[i] >> 16) & 0xFF;
+    const int g = (argb[i] >> 8) & 0xFF;
+    const int b = argb[i] & 0xFF;
+    y[i] = ClampChannel(((r + (g << 1) + b) + 2) >> 2);
+    co[i] = ClampChannel(((r - b + 1) >> 1) + 128);
+    cg[i] = ClampChannel(((-r + (g << 1) - b + 2) >> 2) + 128);
+  }
+}
+
+void YCoCgToRGB(const int16 *y, const int16 *co, const int16 *cg,
+                const uint32 n, uint8 *r, uint8 *g, uint8 *b) {
+  uint32 i = 0;
+#if defined(__AVX2__)
+  const __m256i half = _mm256_set1_epi16(128);
+  for(; i + 16 <= n; i += 16) {
+    const __m256i vy = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + i));
+    const __m256i vco = _mm256_sub_epi16(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(co + i)), half);
+    const __m256i vcg = _mm256_sub_epi16(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cg + i)), half);
+
+    const __m256i vr = _mm256_add_epi16(vy, _mm256_sub_epi16(vco, vcg));
+    const __m256i vg = _mm256_add_epi16(vy, vcg);
+    const __m256i vb = _mm256_sub_epi16(vy, _mm256_add_epi16(vco, vcg));
+
+    // Saturating packs clamp to [0, 255]; they work within 128 bit lanes,
+    // so gather the low half of each lane back together.
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(r + i), _mm256_castsi256_si128(
+      _mm256_permute4x64_epi64(_mm256_packus_epi16(vr, vr), 0xD8)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(g + i), _mm256_castsi256_si128(
+      _mm256_permute4x64_epi64(_mm256_packus_epi16(vg, vg), 0xD8)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(b + i), _mm256_castsi256_si128(
+      _mm256_permute4x64_epi64(_mm256_packus_epi16(vb, vb), 0xD8)));
+  }
+#elif defined(__SSE4_1__)
+  const __m128i half = _mm_set1_epi16(128);
+  for(; i + 8 <= n; i += 8) {
+    const __m128i vy = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i));
+    const __m128i vco = _mm_sub_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(co + i)), half);
+    const __m128i vcg = _mm_sub_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(cg + i)), half);
+
+    const __m128i vr = _mm_add_epi16(vy, _mm_sub_epi16(vco, vcg));
+    const __m128i vg = _mm_add_epi16(vy, vcg);
+    const __m128i vb = _mm_sub_epi16(vy, _mm_add_epi16(vco, vcg));
+
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(r + i), _mm_packus_epi16(vr, vr));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(g + i), _mm_packus_epi16(vg, vg));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(b + i), _mm_packus_epi16(vb, vb));
+  }
+#endif
+
+  for(; i < n; i++) {
+    const int pco = co[i] - 128;
+    const int pcg = cg[i] - 128;
+    r[i] = ClampChannel(y[i] + (pco - pcg));
+    g[i] = ClampChannel(y[i] + pcg);
+    b[i] = ClampChannel(y[i] - (pco + pcg));
+  }
+}
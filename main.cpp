@@ -1,28 +1,20 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <cassert>
-#include <cfloat>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <fstream>
-#include <set>
-#include <unordered_map>
+#include <thread>
 #ifdef _MSC_VER
 #  include <SDKDDKVer.h>
 #  include <Windows.h>
 #endif
 
-#include "Vector4.h"
-#include "Matrix4x4.h"
-using FasTC::Matrix4x4;
-using FasTC::Vec4f;
-
 #include "Pixel.h"
 using FasTC::Pixel;
-using FasTC::YCoCgPixel;
 
 #include "Image.h"
 #include "ImageFile.h"
@@ -32,313 +24,13 @@ using FasTC::YCoCgPixel;
 #include "BPTCCompressor.h"
 
 #include "SLIC.h"
+#include "LabelCache.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include "Partition.h"
+#include "Region.h"
 #include "VPTree.h"
 
-static Matrix4x4<float> ComputeCovarianceMatrix(
-  const std::vector<Vec4f> &points
-) {
-  
-  Vec4f avg;
-  for(int i = 0; i < 4; i++)
-    avg[i] = float(0.0f);
-
-  for(const auto &p : points) {
-    avg += p;
-  }
-  avg /= float(points.size());
-
-  std::vector<Vec4f > toPts;
-  toPts.reserve(points.size());
-
-  for(const auto &p : points) {
-    toPts.push_back(p - avg);
-  }
-  
-  Matrix4x4<float> covMatrix;
-
-  // Compute covariance.
-  for(uint32 i = 0; i < 4; i++) {
-    for(uint32 j = 0; j <= i; j++) {
-
-      float sum(0.0);
-      for(uint32 k = 0; k < points.size(); k++) {
-        sum += toPts[k][i] * toPts[k][j];
-      }
-
-      covMatrix(i, j) = sum / float(4 - 1);
-      covMatrix(j, i) = covMatrix(i, j);
-    }
-  }
-
-  return covMatrix;
-}
-
-struct CompareVecs {
-  bool operator()(const Vec4f &v1, const Vec4f &v2) {
-    for(uint32 i = 0; i < 4; i++) {
-      if(v1[i] != v2[i]) {
-        return v1[i] < v2[i];
-      }
-    }
-    return false;
-  }
-};
-
-static uint32 GetPrincipalAxis(const std::vector<Vec4f> &pts,
-                               Vec4f &axis) {
-
-  // Generate a list of unique points...
-  CompareVecs cv;
-  std::set<Vec4f, CompareVecs> upts(cv);
-  for(const auto &p : pts) {
-    upts.insert(p);
-  }
-
-  assert(upts.size() > 0);
-
-  if(upts.size() == 1) {
-    for(int i = 0; i < 4; i++)
-      axis[i] = float(0.0);
-    return 0;
-
-  // Collinear?
-  } else {
-    typedef typename std::set<Vec4f >::const_iterator Itr;
-    Itr itr = upts.begin();
-    assert(itr != upts.end());
-
-    Vec4f upt0 = *itr;
-    itr++;
-    assert(itr != upts.end());
-
-    Vec4f dir (*itr - upt0);
-    dir.Normalize();
-    itr++;
-
-    bool collinear = true;
-    for(; itr != upts.end(); itr++) {
-      Vec4f v = (*itr - upt0);
-      if(fabs(fabs(v * dir) - v.Length()) > 1e-7) {
-        collinear = false;
-        break;
-      }
-    }
-
-    if(collinear) {
-      axis = dir;
-      return 0;
-    }
-  }
-
-  return ComputeCovarianceMatrix(pts).PowerMethod(axis);
-}
-
-template<typename T>
-static inline T Clamp(const T &a, const T &b, const T &v) {
-  return std::max(a, std::min(v, b));
-}
-
-static uint8 CastChannel(const float &f) {
-  return static_cast<uint8>(f + 0.5f);
-}
-
-static uint8 FloatToChannel(const float &f) {
-  return CastChannel(255.0f * f);
-}
-
-static YCoCgPixel Vec4fToPixel(const Vec4f &v) {
-  YCoCgPixel p;
-  p.Y() = CastChannel(Clamp(0.0f, 255.0f, v[0]));
-  p.Co() = CastChannel(Clamp(0.0f, 255.0f, v[1]));
-  p.Cg() = CastChannel(Clamp(0.0f, 255.0f, v[2]));
-  p.A() = CastChannel(Clamp(0.0f, 255.0f, v[3]));
-  return p;
-}
-
-static void PrintPixel(const char *label, const Pixel &p) {
-  fprintf(stderr, "%s: <%d, %d, %d, %d>\n", label, p.R(), p.G(), p.B(), p.A());
-}
-
-class Region {
-  YCoCgPixel m_Endpoints[2];
-  std::vector<Pixel>::const_iterator m_PixelItr;
-  std::vector<Pixel> m_Pixels;
-  std::vector<uint8> m_Interp;
-  std::vector<uint8> m_LumaInterp;
-
-  double CompressVecs(std::vector<Vec4f> pts) {
-
-//    for(const auto &p : pts) {
-//      fprintf(stderr, "%s: <%.2f, %.2f, %.2f, %.2f>\n", "Pt", p.X(), p.Y(), p.Z(), p.W());
-//    }
-
-    std::vector<float> firstChannel;
-    firstChannel.reserve(pts.size());
-    for(auto &p : pts) {
-      firstChannel.push_back(p[0]);
-      p[0] = 255.0f;
-    }
-
-    Vec4f centroid = Vec4f(0, 0, 0, 0);
-    for(const auto &p : pts) {
-      centroid += p;
-    }
-    centroid /= pts.size();
-//    fprintf(stderr, "Centroid: <%.2f, %.2f, %.2f, %.2f>\n", centroid.X(), centroid.Y(), centroid.Z(), centroid.W());
-
-    float a = FLT_MAX, b = -FLT_MAX;
-    Vec4f axis;
-    if(GetPrincipalAxis(pts, axis) <= 0) {
-      m_Endpoints[0] = m_Endpoints[1] = Vec4fToPixel(centroid);
-      a = b = 0.0f;
-    } else {
-      axis.Normalize();
-
-      for(const auto &pt : pts) {
-        float d = (pt - centroid).Dot(axis);
-        a = std::min(d, a);
-        b = std::max(d, b);
-      }
-
-      m_Endpoints[0] = Vec4fToPixel(centroid + (axis * a));
-      m_Endpoints[1] = Vec4fToPixel(centroid + (axis * b));
-    }
-
-    // Luma...
-    float fmin = *min_element(std::begin(firstChannel), std::end(firstChannel));
-    float fmax = *max_element(std::begin(firstChannel), std::end(firstChannel));
-    m_Endpoints[0].Y() = static_cast<int16>(fmin);
-    m_Endpoints[1].Y() = static_cast<int16>(fmax);
-
-    m_LumaInterp.reserve(m_Pixels.size());
-    m_Interp.reserve(m_Pixels.size());
-    for(uint32 i = 0; i < m_Pixels.size(); i++) {
-      
-      auto p = pts[i];
-      float f = firstChannel[i];
-
-      if(b == a) {
-        m_Interp.push_back(0);
-      } else {
-        float d = (p - centroid).Dot(axis);
-        float nd = (d - a) / (b - a);
-        assert(0.0f <= nd && nd <= 1.0f);
-        m_Interp.push_back(FloatToChannel(nd));
-      }
-
-      if(fmax == fmin) {
-        m_LumaInterp.push_back(0);
-      } else {
-        float d = (f - fmin) / (fmax - fmin);
-        assert(0.0f <= d && d <= 1.0f);
-        m_LumaInterp.push_back(FloatToChannel(d));
-      }
-    }
-
-    return b - a;
-  }
-
-public:
-  Region() { }
-  explicit Region(const std::vector<Pixel> &pixels)
-    : m_Pixels(pixels) { }
-
-  uint32 NumPixels() const { return m_Pixels.size(); }
-  void AddPixel(const Pixel &p) {
-    m_Pixels.push_back(p);
-  }
-
-  void ResetPixelItr() { m_PixelItr = m_Pixels.begin(); }
-  Pixel GetNextPixel() {
-    assert(m_PixelItr != m_Pixels.end());
-    const Pixel &ret = *m_PixelItr;
-    m_PixelItr++;
-    return ret;
-  }
-
-  // Populate m_Endpoints and m_InterpolationValues
-  double Compress() {
-    bool opaque = true;
-    for(const auto &p : m_Pixels) {
-      opaque = opaque && (p.A() >= 255);
-    }
-
-    std::vector<Vec4f> rgbaVecs;
-    rgbaVecs.reserve(m_Pixels.size());
-
-    assert(opaque);
-//    if(opaque) {
-
-      m_Endpoints[0][3] = m_Endpoints[1][3] = 255;
-
-      for(const auto &p : m_Pixels) {
-        YCoCgPixel trans = YCoCgPixel(p);
-        Vec4f v;
-        v[0] = static_cast<float>(static_cast<int16>(trans.Y()));
-        v[1] = static_cast<float>(static_cast<int16>(trans.Co()));
-        v[2] = static_cast<float>(static_cast<int16>(trans.Cg()));
-        v[3] = 255.0f;
-        rgbaVecs.push_back(v);
-      }
-//    } else {
-//
-//      for(const auto &p : m_Pixels) {
-//        Vec4f v;
-//        v[0] = static_cast<float>(p.R());
-//        v[1] = static_cast<float>(p.G());
-//        v[2] = static_cast<float>(p.B());
-//        v[3] = static_cast<float>(p.A());
-//        rgbaVecs.push_back(v);
-//      }
-//    }
-
-    return CompressVecs(rgbaVecs);
-  }
-
-  void Reconstruct() {
-    m_Pixels.clear();
-    m_Pixels.reserve(m_Interp.size());
-
-    for(uint32 i = 0; i < m_Interp.size(); i++) {
-      const auto &v = m_Interp[i];
-      const auto &y = m_LumaInterp[i];
-
-      float yd = static_cast<float>(y) / 255.0f;
-      float vd = static_cast<float>(v) / 255.0f;
-
-      YCoCgPixel p = m_Endpoints[0] * (1 - vd) + m_Endpoints[1] * vd;
-      p.Y() = m_Endpoints[0].Y() * (1 - yd) + m_Endpoints[1].Y() * yd;
-//      PrintPixel("Reconstructed", p);
-      m_Pixels.push_back(p.ToRGBA());
-    }
-
-    ResetPixelItr();
-  }
-};
-
-void CollectPixels(const uint32 kWidth, const uint32 kHeight, 
-                   const Pixel *pixels, const int *labels,
-                   std::unordered_map<uint32, Region> &result) {
-  result.clear();
-  for(uint32 j = 0; j < kHeight; j++) {
-    for(uint32 i = 0; i < kWidth; i++) {
-      uint32 idx = j*kWidth+i;
-      uint32 label = static_cast<uint32>(labels[idx]);
-      Pixel p = pixels[idx];
-
-      if(result.count(label) == 0) {
-        Region r;
-        r.AddPixel(p);
-        std::pair<uint32, Region> newRegion (label, r);
-        result.insert(newRegion);
-      } else {
-        result[label].AddPixel(p);
-      }
-    }
-  }
-}
-
 typedef VpTree<Partition<4, 4>, Partition<4, 4>::Distance> VpTree4x4;
 struct SelectionInfo {
   VpTree4x4 &tree;
@@ -373,6 +65,7 @@ template<const unsigned N, const unsigned M>
 BPTCC::ShapeSelection ChosePresegmentedShape(
   uint32 x, uint32 y, const uint32 pixels[16], const void *userData
 ) {
+  TraceSpan span("ChosePresegmentedShape");
   const SelectionInfo &info = *(reinterpret_cast<const SelectionInfo *>(userData));
 
   // Construct a partition...
@@ -452,72 +145,157 @@ int _tmain(int argc, _TCHAR* argv[]) {
 int main(int argc, char **argv) {
 #endif
 
-  if(argc != 2 && argc != 3) {
-    fprintf(stderr, "Usage: sc <img1>\n");
+  if(argc < 2) {
+    fprintf(stderr, "Usage: sc <img1> [spSize] [<img2> ...]\n");
+    fprintf(stderr, "  More than one image is segmented as the slices of a volume.\n");
+    fprintf(stderr, "  Set SC_CACHE_DIR to reuse segmentations across runs.\n");
+    fprintf(stderr, "  Set SC_METRICS_FILE to write per stage metrics there as JSON.\n");
+    fprintf(stderr, "  Set SC_TRACE_FILE to write a Chrome trace of the run there.\n");
     return 1;
   }
 
+  const char *traceFile = getenv("SC_TRACE_FILE");
+  if(traceFile && traceFile[0]) {
+    Trace::Enable();
+  }
+
   int spSize = 5;
-  if(argc == 3) {
+  if(argc >= 3) {
     sscanf(argv[2], "%d", &spSize);
   }
 
-  ImageFile imgFile (argv[1]);
-  if(!imgFile.Load()) {
-    fprintf(stderr, "Error loading file: %s\n", argv[1]);
-    return 1;
+  std::vector<const char *> sliceFiles(1, argv[1]);
+  for(int i = 3; i < argc; i++) {
+    sliceFiles.push_back(argv[i]);
   }
+  const int kDepth = static_cast<int>(sliceFiles.size());
+
+  int kWidth = 0, kHeight = 0, nPixels = 0;
+  FasTC::Pixel *pixels = NULL;
+  for(int z = 0; z < kDepth; z++) {
+    ScopedStage stage("load");
+    ImageFile imgFile (sliceFiles[z]);
+    if(!imgFile.Load()) {
+      fprintf(stderr, "Error loading file: %s\n", sliceFiles[z]);
+      return 1;
+    }
 
-  FasTC::Image<> *img = imgFile.GetImage();
+    FasTC::Image<> *img = imgFile.GetImage();
+    if(z == 0) {
+      kWidth = img->GetWidth();
+      kHeight = img->GetHeight();
+      nPixels = kWidth * kHeight;
+      pixels = new FasTC::Pixel[nPixels * kDepth];
+    } else if(static_cast<int>(img->GetWidth()) != kWidth ||
+              static_cast<int>(img->GetHeight()) != kHeight) {
+      fprintf(stderr, "Slice %s is not %dx%d\n", sliceFiles[z], kWidth, kHeight);
+      return 1;
+    }
+    memcpy(pixels + z * nPixels, img->GetPixels(), nPixels * sizeof(FasTC::Pixel));
+  }
 
-  const int kWidth = img->GetWidth();
-  const int kHeight = img->GetHeight();
-  const int nPixels = kWidth * kHeight;
-  const uint32 pixelBufSz = nPixels * sizeof(FasTC::Pixel);
+  uint32 *rawPixels = new uint32[nPixels * kDepth];
 
-  FasTC::Pixel *pixels = new FasTC::Pixel[pixelBufSz];
-  memcpy(pixels, img->GetPixels(), pixelBufSz);
+  {
+    ScopedStage stage("pack");
+    for(int i = 0; i < nPixels * kDepth; i++) {
+      // Pixels are stored as little endian ARGB, so we want ABGR
+      FasTC::Pixel p = pixels[i];
+      p.Shuffle(0x6C); // 01 10 11 00
+      rawPixels[i] = p.Pack();
+    }
+  }
 
-  uint32 *rawPixels = new uint32[kWidth * kHeight];
+  int *labels = new int[nPixels * kDepth];
+  int numLabels;
 
-  for(int i = 0; i < nPixels; i++) {
-    // Pixels are stored as little endian ARGB, so we want ABGR
-    pixels[i].Shuffle(0x6C); // 01 10 11 00
-    rawPixels[i] = pixels[i].Pack();
+  const int numThreads = std::max(1u, std::thread::hardware_concurrency());
+  const double compactness = 1.0;
+
+  // Reuse the labels of an earlier run on the same input, if any
+  const char *cacheDir = getenv("SC_CACHE_DIR");
+  LabelCache cache(cacheDir ? cacheDir : "");
+  uint64 cacheKey = 0;
+  bool cacheHit = false;
+  if(cache.IsEnabled()) {
+    ScopedStage stage("cache.load");
+    cacheKey = LabelCache::MakeKey(rawPixels, kWidth, kHeight, kDepth, spSize, compactness);
+    cacheHit = cache.Load(cacheKey, kWidth, kHeight, kDepth, labels, numLabels);
   }
 
-  int *labels = new int[nPixels];
-  int numLabels;
+  SLIC<float> slic;
+  if(cacheHit) {
+    std::cout << "Loaded labels from the segmentation cache" << std::endl;
+  } else {
+    ScopedStage stage("segment");
+    if(kDepth == 1) {
+      slic.PerformSLICO_ForGivenStepSize(
+        rawPixels,
+        kWidth,
+        kHeight,
+        labels,
+        numLabels,
+        spSize, compactness, numThreads);
+    } else {
+      // Supervoxels, so that a region spans the slices it covers
+      std::vector<const unsigned int *> rawSlices(kDepth);
+      std::vector<int *> labelSlices(kDepth);
+      for(int z = 0; z < kDepth; z++) {
+        rawSlices[z] = rawPixels + z * nPixels;
+        labelSlices[z] = labels + z * nPixels;
+      }
+      slic.PerformSLICO_ForGivenStepSize_Supervoxels(
+        &rawSlices[0], kWidth, kHeight, kDepth,
+        &labelSlices[0], numLabels, spSize, compactness, numThreads);
+    }
+  }
 
-  SLIC slic;
-  slic.PerformSLICO_ForGivenStepSize(
-    rawPixels,
-	kWidth,
-    kHeight,
-    labels,
-    numLabels,
-	spSize, 1.0);
-
-  std::unordered_map<uint32, Region> regions;
-  CollectPixels(kWidth, kHeight, pixels, labels, regions);
-  std::cout << "Num regions: " << regions.size() << std::endl;
-
-  for(auto &r : regions) {
-    r.second.Compress();
-    r.second.Reconstruct();
+  if(!cacheHit) {
+    // Break the segmentation down into the stages SLIC timed itself
+    const SLIC<float>::StageTimings &timings = slic.GetStageTimings();
+    double iterationTime = 0.0;
+    for(double t : timings.iterations) {
+      iterationTime += t;
+    }
+    Metrics &metrics = Metrics::Get();
+    metrics.AddTiming("segment.lab", timings.labconversion);
+    metrics.AddTiming("segment.seeding", timings.seeding);
+    metrics.AddTiming("segment.iteration", iterationTime, timings.iterations.size());
+    metrics.AddTiming("segment.connectivity", timings.connectivity);
+
+    if(cache.IsEnabled()) {
+      ScopedStage stage("cache.store");
+      cache.Store(cacheKey, kWidth, kHeight, kDepth, labels, numLabels);
+    }
   }
 
-  for(int i = 0; i < nPixels; i++) {
-    pixels[i] = regions[labels[i]].GetNextPixel();
-    pixels[i].Shuffle(0x6C);
+  // The slices are stacked, so the volume is one tall image here
+  RegionSet regions;
+  {
+    ScopedStage stage("collect");
+    regions.CollectPixels(rawPixels, labels, nPixels * kDepth, numLabels);
   }
+  std::cout << "Num regions: " << regions.NumRegions() << std::endl;
 
-  std::vector<Partition<4, 4> > partitions;
-  EnumerateBPTC(partitions);
-  std::cout << partitions.size() << " 4x4 BPTC partitions" << std::endl;
+  {
+    ScopedStage stage("compress", regions.NumRegions());
+    std::vector<RegionScratch> scratch(numThreads, RegionScratch(regions.MaxRegionPixels()));
+    regions.ForEachRegion(numThreads, [&scratch](int t, Region &r) { r.Compress(scratch[t]); });
+  }
 
+  {
+    ScopedStage stage("reconstruct", regions.NumRegions());
+    regions.ForEachRegion(numThreads, [pixels](int, Region &r) { r.Reconstruct(pixels); });
+  }
+
+  std::vector<Partition<4, 4> > partitions;
   VpTree<Partition<4, 4>, Partition<4, 4>::Distance> vptree;
-  vptree.create(partitions);
+  {
+    ScopedStage stage("vptree.build");
+    EnumerateBPTC(partitions);
+    vptree.create(partitions);
+  }
+  std::cout << partitions.size() << " 4x4 BPTC partitions" << std::endl;
 
   // Just to test, find the partition close to half 0 half 1..
   Partition<4, 4> test;
@@ -537,31 +315,75 @@ int main(int argc, char **argv) {
   settings.m_NumSimulatedAnnealingSteps = 0;
   settings.m_ShapeSelectionFn = ChosePresegmentedShape<4, 4>;
 
-  SelectionInfo info(vptree, labels, kWidth, kHeight);
-  settings.m_ShapeSelectionUserData = &info;
-
   uint8 *outBuf = new uint8[kWidth * kHeight];
-  FasTC::CompressionJob cj(
-     FasTC::eCompressionFormat_BPTC,
-     reinterpret_cast<const uint8 *>(pixels),
-     outBuf,
-     static_cast<uint32>(kWidth),
-     static_cast<uint32>(kHeight));
+  for(int z = 0; z < kDepth; z++) {
+    const FasTC::Pixel *slicePixels = pixels + z * nPixels;
+
+    SelectionInfo info(vptree, labels + z * nPixels, kWidth, kHeight);
+    settings.m_ShapeSelectionUserData = &info;
+
+    FasTC::CompressionJob cj(
+       FasTC::eCompressionFormat_BPTC,
+       reinterpret_cast<const uint8 *>(slicePixels),
+       outBuf,
+       static_cast<uint32>(kWidth),
+       static_cast<uint32>(kHeight));
+
+    StopWatch sw;
+    sw.Start();
+    {
+      ScopedStage stage("bptc.compress");
+      TraceSpan span("BPTCC::Compress");
+      BPTCC::Compress(cj, settings);
+    }
+    sw.Stop();
+    std::cout << "Compression time: " << sw.TimeInMilliseconds() << "ms" << std::endl;
 
-  StopWatch sw;
-  sw.Start();
-  BPTCC::Compress(cj, settings);
-  sw.Stop();
-  std::cout << "Compression time: " << sw.TimeInMilliseconds() << "ms" << std::endl;
+    CompressedImage ci(kWidth, kHeight, FasTC::eCompressionFormat_BPTC, outBuf);
+    FasTC::Image<> outImg(kWidth, kHeight, slicePixels);
 
-  CompressedImage ci(kWidth, kHeight, FasTC::eCompressionFormat_BPTC, outBuf);
-  FasTC::Image<> outImg(kWidth, kHeight, pixels);
+    double psnr;
+    {
+      ScopedStage stage("psnr");
+      psnr = outImg.ComputePSNR(&ci);
+    }
+    std::cout << "PSNR: " << psnr << "db" << std::endl;
 
-  std::cout << "PSNR: " << outImg.ComputePSNR(&ci) << "db" << std::endl;
+    char outName[64];
+    if(kDepth == 1) {
+      snprintf(outName, sizeof(outName), "out.png");
+    } else {
+      snprintf(outName, sizeof(outName), "out%d.png", z);
+    }
+    ScopedStage stage("png.write");
+    ImageFile outImgFile(outName, eFileFormat_PNG, outImg);
+    outImgFile.Write();
+  }
 
-  ImageFile outImgFile("out.png", eFileFormat_PNG, outImg);
-  outImgFile.Write();
+  const char *metricsFile = getenv("SC_METRICS_FILE");
+  if(metricsFile && metricsFile[0]) {
+    Metrics &metrics = Metrics::Get();
+    metrics.AddCounter("pixels", static_cast<uint64>(nPixels) * kDepth);
+    metrics.AddCounter("labels", numLabels);
+    metrics.AddCounter("regions", regions.NumRegions());
+    metrics.AddCounter("cache.hits", cacheHit ? 1 : 0);
+    metrics.AddCounter("slic.iterations", cacheHit ? 0 : slic.GetNumIterations());
+
+    const VpTree4x4::SearchStats &searchStats = vptree.stats();
+    metrics.AddCounter("vptree.searches", searchStats.searches);
+    metrics.AddCounter("vptree.nodesVisited", searchStats.nodesVisited);
+    metrics.AddCounter("vptree.subtreesPruned", searchStats.subtreesPruned);
+
+    if(!metrics.WriteJSON(metricsFile)) {
+      fprintf(stderr, "Error writing metrics to %s\n", metricsFile);
+    }
+  }
+
+  if(Trace::IsEnabled() && !Trace::Write(traceFile)) {
+    fprintf(stderr, "Error writing trace to %s\n", traceFile);
+  }
 
+  delete [] outBuf;
   delete [] labels;
   delete [] rawPixels;
   delete [] pixels;